@@ -9,7 +9,7 @@ QT       += core
 QT       -= gui
 
 TARGET = OneWire
-CONFIG   += console c++11
+CONFIG   += console c++2a
 CONFIG   -= app_bundle
 
 TEMPLATE = app
@@ -17,8 +17,61 @@ TEMPLATE = app
 target.path = /data/bin
 INSTALLS += target
 
+LIBS += -lrt
+
+# coroutines still need to be enabled explicitly on gcc 10
+*-g++*: QMAKE_CXXFLAGS += -fcoroutines
+
 SOURCES += main.cpp \
-    ds2482.cpp
+    ds2431provisioner.cpp \
+    ds2480b.cpp \
+    ds2480bsim.cpp \
+    ds2482.cpp \
+    ds2482async.cpp \
+    ds2482bus.cpp \
+    i2ctrace.cpp \
+    w1bridge.cpp \
+    w1cache.cpp \
+    w1churn.cpp \
+    w1daemon.cpp \
+    w1executor.cpp \
+    w1inventory.cpp \
+    w1linktuner.cpp \
+    w1piosampler.cpp \
+    w1romregistry.cpp \
+    w1rtthread.cpp \
+    w1scheduler.cpp \
+    w1shm.cpp \
+    w1simbridge.cpp \
+    w1simbus.cpp \
+    w1telemetry.cpp \
+    w1touchport.cpp
 
 HEADERS += \
-    ds2482.h
+    ds2431provisioner.h \
+    ds2480b.h \
+    ds2480bsim.h \
+    ds2482.h \
+    ds2482async.h \
+    ds2482bus.h \
+    i2ctrace.h \
+    w1bridge.h \
+    w1cache.h \
+    w1churn.h \
+    w1clock.h \
+    w1daemon.h \
+    w1executor.h \
+    w1inventory.h \
+    w1linktuner.h \
+    w1piosampler.h \
+    w1romregistry.h \
+    w1rtthread.h \
+    w1scheduler.h \
+    w1sequence.h \
+    w1shm.h \
+    w1simbridge.h \
+    w1simbus.h \
+    w1spscqueue.h \
+    w1task.h \
+    w1telemetry.h \
+    w1touchport.h
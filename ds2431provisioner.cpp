@@ -0,0 +1,397 @@
+#include "ds2431provisioner.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "w1clock.h"
+#include "w1sequence.h"
+
+struct DS2431Provisioner::lane_s {
+    enum state_t {
+        STATE_WRITE_ROW,
+        STATE_VERIFY,
+        STATE_COPY_WAIT,
+        STATE_READ_BACK,
+        STATE_DONE
+    };
+
+    DS2482 *ds;
+    int channel;
+    QList<device_result_t> devices;
+
+    state_t state;
+    int row;
+    int device;
+    int64_t busyUntil;
+};
+
+DS2431Provisioner::DS2431Provisioner()
+{
+
+}
+
+DS2431Provisioner::~DS2431Provisioner()
+{
+    foreach (lane_s *lane, lanes)
+    {
+        delete lane;
+    }
+}
+
+int DS2431Provisioner::addLane(DS2482 *ds, int channel, const QList<uint64_t> &devices)
+{
+    lane_s *lane = new lane_s();
+    lane->ds = ds;
+    lane->channel = channel;
+
+    foreach (uint64_t rom, devices)
+    {
+        if ((rom & 0xFF) != DS2431_FAMILY_CODE)
+        {
+            fprintf(stderr, "%016llx is not a DS2431\n", (unsigned long long) rom);
+            delete lane;
+            return -1;
+        }
+
+        device_result_t result;
+        result.rom = rom;
+        result.status = DEVICE_PENDING;
+        result.row = 0;
+        lane->devices << result;
+    }
+
+    lanes << lane;
+
+    return 0;
+}
+
+void DS2431Provisioner::setOverdrive(bool _overdrive)
+{
+    overdrive = _overdrive;
+}
+
+void DS2431Provisioner::setStrongPullup(bool _strongPullup)
+{
+    strongPullup = _strongPullup;
+}
+
+void DS2431Provisioner::setControlPage(bool _controlPage)
+{
+    controlPage = _controlPage;
+}
+
+QList<DS2431Provisioner::device_result_t> DS2431Provisioner::results() const
+{
+    QList<device_result_t> result;
+    foreach (lane_s *lane, lanes)
+    {
+        result += lane->devices;
+    }
+    return result;
+}
+
+void DS2431Provisioner::fail(lane_s &lane, int device, device_status_t status)
+{
+    lane.devices[device].status = status;
+    lane.devices[device].row = lane.row;
+}
+
+int DS2431Provisioner::selectLane(lane_s &lane)
+{
+    if (lane.channel >= 0 && lane.ds->select_channel(lane.channel) != 0)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+// Lane steps
+//------------------------------------------------------------------------------
+int DS2431Provisioner::writeRow(lane_s &lane)
+{
+    int rowAddress = address + lane.row * DS2431_ROW_SIZE;
+
+    DS2431BroadcastScratchpad write;
+    write.setAddress(rowAddress);
+    memcpy(write.payload(), image + lane.row * DS2431_ROW_SIZE, DS2431_ROW_SIZE);
+
+    // every device listens, the CRC that follows would collide and is skipped
+    int ret = overdrive ? lane.ds->w1_overdrive_skip_rom() : lane.ds->w1_skip_rom();
+    if (ret != 0 || write.execute(*lane.ds) != W1SEQ_OK)
+    {
+        fprintf(stderr, "Could not broadcast row %d\n", lane.row);
+        return -1;
+    }
+
+    lane.device = 0;
+    lane.state = lane_s::STATE_VERIFY;
+
+    return 0;
+}
+
+int DS2431Provisioner::verifyAndCopy(lane_s &lane)
+{
+    device_result_t &dev = lane.devices[lane.device];
+    int rowAddress = address + lane.row * DS2431_ROW_SIZE;
+
+    if (dev.status != DEVICE_PENDING)
+    {
+        lane.device++;
+        return 0;
+    }
+
+    int ret = overdrive ? lane.ds->w1_overdrive_match_rom(dev.rom)
+                        : lane.ds->w1_match_rom(dev.rom);
+    if (ret != 0)
+    {
+        fail(lane, lane.device++, DEVICE_BUS_ERROR);
+        return 0;
+    }
+
+    DS2431ReadScratchpad read;
+    ret = read.execute(*lane.ds);
+    if (ret == W1SEQ_BUS_ERROR)
+    {
+        fail(lane, lane.device++, DEVICE_BUS_ERROR);
+        return 0;
+    }
+
+    // TA1, TA2, E/S, data
+    const uint8_t *scratchpad = read.response();
+    if (ret == W1SEQ_CRC_ERROR
+            || scratchpad[0] != (rowAddress & 0xFF) || scratchpad[1] != (rowAddress >> 8)
+            || scratchpad[2] != DS2431_ROW_SIZE - 1
+            || memcmp(scratchpad + 3, image + lane.row * DS2431_ROW_SIZE, DS2431_ROW_SIZE) != 0)
+    {
+        fail(lane, lane.device++, DEVICE_SCRATCHPAD_FAILED);
+        return 0;
+    }
+
+    // authorise the copy with the address and E/S byte we just read
+    DS2431CopyScratchpad copy;
+    copy.setAddress(scratchpad[0] | (scratchpad[1] << 8));
+    copy.payload()[0] = scratchpad[2];
+    if (lane.ds->w1_resume() != 0 || copy.execute(*lane.ds, strongPullup) != W1SEQ_OK)
+    {
+        fail(lane, lane.device++, DEVICE_BUS_ERROR);
+        return 0;
+    }
+
+    // programming starts with the last bit of the copy, not when this pass did
+    lane.busyUntil = w1_now_us() + DS2431_PROG_TIME_US;
+    lane.state = lane_s::STATE_COPY_WAIT;
+
+    return 0;
+}
+
+int DS2431Provisioner::checkCopy(lane_s &lane)
+{
+    if (strongPullup)
+    {
+        lane.ds->set_strong_pullup(false);
+    }
+
+    int ret = lane.ds->w1_read_byte();
+    if (ret < 0)
+    {
+        fail(lane, lane.device, DEVICE_BUS_ERROR);
+    } else if (ret != DS2431_COPY_DONE) {
+        fail(lane, lane.device, DEVICE_COPY_FAILED);
+    }
+
+    lane.device++;
+    lane.state = lane_s::STATE_VERIFY;
+
+    return 0;
+}
+
+int DS2431Provisioner::readBack(lane_s &lane)
+{
+    device_result_t &dev = lane.devices[lane.device];
+
+    if (dev.status == DEVICE_PENDING)
+    {
+        uint8_t buf[DS2431_MEMORY_SIZE];
+        if (lane.ds->ds2431_read_memory(dev.rom, address, buf, len) < 0)
+        {
+            fail(lane, lane.device, DEVICE_BUS_ERROR);
+        } else if (memcmp(buf, image, len) != 0) {
+            fail(lane, lane.device, DEVICE_VERIFY_FAILED);
+        } else {
+            dev.status = DEVICE_OK;
+        }
+    }
+
+    lane.device++;
+    if (lane.device == lane.devices.count())
+    {
+        lane.state = lane_s::STATE_DONE;
+    }
+
+    return 0;
+}
+
+int DS2431Provisioner::step(lane_s &lane)
+{
+    if (selectLane(lane) != 0)
+    {
+        return -1;
+    }
+
+    switch (lane.state)
+    {
+    case lane_s::STATE_WRITE_ROW:
+        return writeRow(lane);
+
+    case lane_s::STATE_VERIFY:
+        if (lane.device < lane.devices.count())
+        {
+            return verifyAndCopy(lane);
+        }
+
+        lane.row++;
+        if (lane.row * DS2431_ROW_SIZE < len)
+        {
+            lane.state = lane_s::STATE_WRITE_ROW;
+        } else {
+            if (overdrive)
+            {
+                lane.ds->set_high_speed(false);
+            }
+            lane.device = 0;
+            lane.state = lane.devices.isEmpty() ? lane_s::STATE_DONE : lane_s::STATE_READ_BACK;
+        }
+        return 0;
+
+    case lane_s::STATE_COPY_WAIT:
+        return checkCopy(lane);
+
+    case lane_s::STATE_READ_BACK:
+        return readBack(lane);
+
+    case lane_s::STATE_DONE:
+        break;
+    }
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+// Pipeline
+//------------------------------------------------------------------------------
+int DS2431Provisioner::run(int _address, const uint8_t *_image, int _len)
+{
+    if (_address < 0 || _address % DS2431_ROW_SIZE != 0 || _len <= 0
+            || _len % DS2431_ROW_SIZE != 0 || _address + _len > DS2431_MEMORY_SIZE)
+    {
+        fprintf(stderr, "Invalid DS2431 image range %d+%d\n", _address, _len);
+        return -1;
+    }
+    if (_address + _len > DS2431_DATA_SIZE && !controlPage)
+    {
+        fprintf(stderr, "DS2431 image range %d+%d includes the protection and control page\n",
+                _address, _len);
+        return -1;
+    }
+
+    address = _address;
+    image = _image;
+    len = _len;
+
+    int64_t start = w1_now_us();
+    foreach (lane_s *lane, lanes)
+    {
+        lane->state = lane_s::STATE_WRITE_ROW;
+        lane->row = 0;
+        lane->device = 0;
+        lane->busyUntil = start;
+        for (int i = 0; i < lane->devices.count(); i++)
+        {
+            lane->devices[i].status = DEVICE_PENDING;
+            lane->devices[i].row = 0;
+        }
+    }
+
+    for (;;)
+    {
+        int64_t now = w1_now_us();
+        int64_t wakeup = INT64_MAX;
+        bool active = false;
+        bool stepped = false;
+
+        // a lane in its copy wait keeps the bridge when the strong pullup
+        // is on, otherwise only its own channel
+        QList<DS2482 *> heldBridges;
+        foreach (lane_s *lane, lanes)
+        {
+            if (strongPullup && lane->state == lane_s::STATE_COPY_WAIT && lane->busyUntil > now)
+            {
+                heldBridges << lane->ds;
+            }
+        }
+
+        foreach (lane_s *lane, lanes)
+        {
+            if (lane->state == lane_s::STATE_DONE)
+            {
+                continue;
+            }
+            active = true;
+
+            if (lane->busyUntil > now)
+            {
+                wakeup = qMin(wakeup, lane->busyUntil);
+                continue;
+            }
+            if (heldBridges.contains(lane->ds) && lane->state != lane_s::STATE_COPY_WAIT)
+            {
+                continue;
+            }
+
+            if (step(*lane) != 0)
+            {
+                fprintf(stderr, "Lane on channel %d failed in row %d\n", lane->channel, lane->row);
+                for (int i = 0; i < lane->devices.count(); i++)
+                {
+                    if (lane->devices[i].status == DEVICE_PENDING)
+                    {
+                        fail(*lane, i, DEVICE_BUS_ERROR);
+                    }
+                }
+                lane->state = lane_s::STATE_DONE;
+            }
+            stepped = true;
+
+            // the copy just started, later lanes on this bridge have to wait
+            if (strongPullup && lane->state == lane_s::STATE_COPY_WAIT)
+            {
+                heldBridges << lane->ds;
+            }
+        }
+
+        if (!active)
+        {
+            break;
+        }
+
+        if (!stepped && wakeup != INT64_MAX)
+        {
+            w1_sleep_until_us(wakeup);
+        }
+    }
+
+    elapsed = w1_now_us() - start;
+
+    int failed = 0;
+    foreach (const device_result_t &dev, results())
+    {
+        if (dev.status != DEVICE_OK)
+        {
+            failed++;
+        }
+    }
+
+    return failed;
+}
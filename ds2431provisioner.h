@@ -0,0 +1,97 @@
+#pragma once
+
+#include <QList>
+
+#include <stdint.h>
+
+#include "ds2482.h"
+
+#define DS2431_PROG_TIME_US   10000
+#define DS2431_COPY_DONE      0xAA
+
+/*!
+ * \class DS2431Provisioner
+ *
+ * \brief Programs the same memory image into many DS2431 on several buses
+ *
+ * Every 8 byte row is written once to all devices of a lane with SKIP ROM.
+ * Each device then gets its scratchpad read back and checked with MATCH ROM
+ * and is authorised to copy with RESUME. While a device programs its row,
+ * the other lanes (other bridges, or other channels of a DS2482-800 when no
+ * strong pullup is used) keep working, so the 10 ms copy time overlaps.
+ * After the last row the written range is read back from every device.
+ */
+class DS2431Provisioner
+{
+public:
+    enum device_status_t {
+        DEVICE_PENDING = 0,
+        DEVICE_OK,
+        DEVICE_SCRATCHPAD_FAILED,
+        DEVICE_COPY_FAILED,
+        DEVICE_VERIFY_FAILED,
+        DEVICE_BUS_ERROR
+    };
+
+    struct device_result_t {
+        uint64_t rom;
+        device_status_t status;
+        int row;
+    };
+
+    DS2431Provisioner();
+    ~DS2431Provisioner();
+
+    /*!
+     * \brief addLane - adds a bus with devices to program
+     * \param ds - bridge, not owned
+     * \param channel - DS2482-800 channel, -1 for single channel bridges
+     * \param devices - DS2431 ids on that bus
+     * \return 0 on success, -1 on failure
+     */
+    int addLane(DS2482 *ds, int channel, const QList<uint64_t> &devices);
+
+    // use overdrive speed for all transfers
+    void setOverdrive(bool overdrive);
+    // keep a strong pullup during the copy, needed on weakly powered buses
+    void setStrongPullup(bool strongPullup);
+    /*!
+     * \brief setControlPage - allows images that reach into 0x80-0x8F, the
+     * protection and control bytes can write protect or EPROM lock pages for good
+     */
+    void setControlPage(bool controlPage);
+
+    /*!
+     * \brief run - programs the image into all devices of all lanes
+     * \param address - start address, multiple of 8
+     * \param image - data to program
+     * \param len - image size, multiple of 8, the range has to end before
+     * DS2431_DATA_SIZE unless setControlPage() was set
+     * \return number of devices that failed, -1 on invalid arguments
+     */
+    int run(int address, const uint8_t *image, int len);
+
+    QList<device_result_t> results() const;
+    int64_t elapsedUs() const { return elapsed; }
+
+private:
+    struct lane_s;
+
+    int step(lane_s &lane);
+    int writeRow(lane_s &lane);
+    int verifyAndCopy(lane_s &lane);
+    int checkCopy(lane_s &lane);
+    int readBack(lane_s &lane);
+    int selectLane(lane_s &lane);
+    void fail(lane_s &lane, int device, device_status_t status);
+
+    QList<lane_s *> lanes;
+    bool overdrive = false;
+    bool strongPullup = false;
+    bool controlPage = false;
+
+    int address = 0;
+    const uint8_t *image = nullptr;
+    int len = 0;
+    int64_t elapsed = 0;
+};
@@ -0,0 +1,584 @@
+#include "ds2480b.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+DS2480B::DS2480B()
+{
+
+}
+
+DS2480B::~DS2480B()
+{
+    close();
+}
+
+int DS2480B::open(QString deviceFile)
+{
+    close();
+
+    fd = ::open(deviceFile.toLocal8Bit().constData(), O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        w1_log("Could not open %s: %m\n", deviceFile.toLocal8Bit().constData());
+        return -1;
+    }
+
+    struct termios tio;
+    if (tcgetattr(fd, &tio) != 0)
+    {
+        w1_log("Could not get serial settings: %m\n");
+        close();
+        return -1;
+    }
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, B9600);
+    cfsetospeed(&tio, B9600);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cflag &= ~(CSTOPB | CRTSCTS);
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    if (tcsetattr(fd, TCSANOW, &tio) != 0)
+    {
+        w1_log("Could not set serial settings: %m\n");
+        close();
+        return -1;
+    }
+
+    if (detect() != 0)
+    {
+        w1_log("No DS2480B found on %s\n", deviceFile.toLocal8Bit().constData());
+        close();
+        return -1;
+    }
+
+    return 0;
+}
+
+void DS2480B::close()
+{
+    if (fd != -1)
+    {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+int DS2480B::detect()
+{
+    // a break resets the chip to command mode at 9600 baud
+    tcsendbreak(fd, 0);
+    usleep(2000);
+    tcflush(fd, TCIOFLUSH);
+    dataModeActive = false;
+    highSpeed = false;
+    pullupArmed = false;
+    pulseActive = false;
+
+    // the first reset only calibrates the baud rate and is not answered
+    uint8_t timing = DS2480B_CMD_COMM | DS2480B_FUNC_RESET | DS2480B_SPEED_STANDARD;
+    if (transfer(&timing, 1, NULL, 0) != 0)
+    {
+        return -1;
+    }
+    usleep(4000);
+    tcflush(fd, TCIFLUSH);
+
+    // flexible speed timing, unlimited strong pullup, then read back the
+    // baud rate and run a bit to check the chip answers consistently
+    uint8_t config[] = {
+        DS2480B_CMD_CONFIG | DS2480B_PARAM_SLEW | DS2480B_SLEW_1V37,
+        DS2480B_CMD_CONFIG | DS2480B_PARAM_WRITE1 | DS2480B_WRITE1_10US,
+        DS2480B_CMD_CONFIG | DS2480B_PARAM_SAMPLE | DS2480B_SAMPLE_8US,
+        DS2480B_CMD_CONFIG | DS2480B_PARAM_PULLUP | DS2480B_PULLUP_INFINITE,
+        DS2480B_CMD_CONFIG | (DS2480B_PARAM_BAUD >> 3),
+        DS2480B_CMD_COMM | DS2480B_FUNC_BIT | DS2480B_BIT_ONE | DS2480B_SPEED_STANDARD
+    };
+    uint8_t response[sizeof(config)];
+    if (transfer(config, sizeof(config), response, sizeof(response)) != 0)
+    {
+        return -1;
+    }
+
+    // writes echo the command without bit 0
+    for (int i = 0; i < 4; i++)
+    {
+        if (response[i] != (config[i] & ~1))
+        {
+            w1_log("Unexpected DS2480B config response %02x\n", response[i]);
+            return -1;
+        }
+    }
+    if ((response[4] & 0xF1) != 0 || (response[4] & 0x0E) != DS2480B_BAUD_9600)
+    {
+        w1_log("Unexpected DS2480B baud rate response %02x\n", response[4]);
+        return -1;
+    }
+    if ((response[5] & 0xF0) != 0x90)
+    {
+        w1_log("Unexpected DS2480B bit response %02x\n", response[5]);
+        return -1;
+    }
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+// Serial access
+//------------------------------------------------------------------------------
+int DS2480B::transfer(const uint8_t *out, int outLen, uint8_t *in, int inLen)
+{
+    if (fd == -1)
+    {
+        w1_log("DS2480B not open\n");
+        return -1;
+    }
+
+    int done = 0;
+    while (done < outLen)
+    {
+        int ret = write(fd, out + done, outLen - done);
+        if (ret < 0 && errno != EINTR && errno != EAGAIN)
+        {
+            w1_log("Could not write to DS2480B: %m\n");
+            return -1;
+        }
+        done += ret > 0 ? ret : 0;
+    }
+
+    done = 0;
+    while (done < inLen)
+    {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        int ret = poll(&pfd, 1, DS2480B_TIMEOUT_MS);
+        if (ret == 0)
+        {
+            // the mode of the chip is unknown now, start the next transfer clean
+            w1_log("DS2480B timeout after %d of %d bytes\n", done, inLen);
+            tcflush(fd, TCIFLUSH);
+            return -1;
+        }
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            w1_log("Could not poll DS2480B: %m\n");
+            return -1;
+        }
+
+        ret = read(fd, in + done, inLen - done);
+        if (ret < 0 && errno != EINTR && errno != EAGAIN)
+        {
+            w1_log("Could not read from DS2480B: %m\n");
+            return -1;
+        }
+        done += ret > 0 ? ret : 0;
+    }
+
+    return 0;
+}
+
+int DS2480B::commandMode()
+{
+    if (!dataModeActive)
+    {
+        return 0;
+    }
+
+    uint8_t cmd = DS2480B_MODE_COMMAND;
+    dataModeActive = false;
+
+    return transfer(&cmd, 1, NULL, 0);
+}
+
+int DS2480B::dataMode()
+{
+    if (dataModeActive)
+    {
+        return 0;
+    }
+
+    uint8_t cmd = DS2480B_MODE_DATA;
+    dataModeActive = true;
+
+    return transfer(&cmd, 1, NULL, 0);
+}
+
+uint8_t DS2480B::speedBits() const
+{
+    return highSpeed ? DS2480B_SPEED_OVERDRIVE : DS2480B_SPEED_FLEX;
+}
+
+int DS2480B::touchBlock(const uint8_t *out, uint8_t *in, int len)
+{
+    // one serial write per chunk, a data byte equal to the command mode
+    // switch is sent twice
+    uint8_t buf[2 * DS2480B_MAX_BLOCK];
+
+    if (dataMode() != 0)
+    {
+        return -1;
+    }
+
+    while (len > 0)
+    {
+        int chunk = len > DS2480B_MAX_BLOCK ? DS2480B_MAX_BLOCK : len;
+        int n = 0;
+        for (int i = 0; i < chunk; i++)
+        {
+            buf[n++] = out[i];
+            if (out[i] == DS2480B_MODE_COMMAND)
+            {
+                buf[n++] = DS2480B_MODE_COMMAND;
+            }
+        }
+
+        if (transfer(buf, n, in, chunk) != 0)
+        {
+            dataModeActive = false;
+            return -1;
+        }
+
+        out += chunk;
+        in += chunk;
+        len -= chunk;
+    }
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+// Bridge configuration
+//------------------------------------------------------------------------------
+int DS2480B::set_active_pullup(bool activePullup)
+{
+    // the DS2480B always drives the rising edge, the slew rate is configured
+    // in detect()
+    (void) activePullup;
+    return 0;
+}
+
+int DS2480B::set_high_speed(bool _highSpeed)
+{
+    if (highSpeed == _highSpeed)
+    {
+        return 0;
+    }
+    highSpeed = _highSpeed;
+
+    // data mode runs at the speed of the last command, search off switches
+    // it without a time slot on the bus
+    if (commandMode() != 0)
+    {
+        return -1;
+    }
+
+    uint8_t cmd = DS2480B_CMD_COMM | DS2480B_FUNC_SEARCH_OFF | speedBits();
+    if (transfer(&cmd, 1, NULL, 0) != 0)
+    {
+        w1_log("Could not change speed\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+int DS2480B::set_strong_pullup(bool strongPullup)
+{
+    if (strongPullup)
+    {
+        // applied after the next written byte
+        pullupArmed = true;
+        return 0;
+    }
+
+    pullupArmed = false;
+    if (!pulseActive)
+    {
+        return 0;
+    }
+
+    if (commandMode() != 0)
+    {
+        return -1;
+    }
+
+    uint8_t cmd[2] = {
+        DS2480B_MODE_STOP_PULSE,
+        DS2480B_CMD_COMM | DS2480B_FUNC_CHMOD | DS2480B_SPEED_PULSE
+    };
+    uint8_t response[2];
+    pulseActive = false;
+    if (transfer(cmd, 2, response, 2) != 0
+            || (response[0] & 0xE0) != 0xE0 || (response[1] & 0xE0) != 0xE0)
+    {
+        w1_log("Could not stop strong pullup\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+// W1 primitives
+//------------------------------------------------------------------------------
+int DS2480B::w1_reset()
+{
+    if (commandMode() != 0)
+    {
+        return -1;
+    }
+
+    uint8_t cmd = DS2480B_CMD_COMM | DS2480B_FUNC_RESET | speedBits();
+    uint8_t response;
+    if (transfer(&cmd, 1, &response, 1) != 0)
+    {
+        w1_log("Could not send w1 reset command\n");
+        return -1;
+    }
+
+    if ((response & 0xC0) != 0xC0)
+    {
+        w1_log("Unexpected reset response %02x\n", response);
+        return -1;
+    }
+
+    switch (response & DS2480B_RESET_MASK)
+    {
+    case DS2480B_RESET_SHORT:
+        w1_log("bus shorted\n");
+        return 0;
+    case DS2480B_RESET_NONE:
+        return 0;
+    default:
+        return 1;
+    }
+}
+
+int DS2480B::bitCommand(int bit)
+{
+    if (commandMode() != 0)
+    {
+        return -1;
+    }
+
+    uint8_t cmd = DS2480B_CMD_COMM | DS2480B_FUNC_BIT | (bit ? DS2480B_BIT_ONE : 0) | speedBits();
+    uint8_t response;
+    if (transfer(&cmd, 1, &response, 1) != 0 || (response & 0xFC) != (cmd & 0xFC))
+    {
+        w1_log("Could not run single bit\n");
+        return -1;
+    }
+
+    return response & 1;
+}
+
+int DS2480B::w1_read_bit()
+{
+    return bitCommand(1);
+}
+
+int DS2480B::w1_write_bit(bit_t bit)
+{
+    return bitCommand(bit) < 0 ? -1 : 0;
+}
+
+int DS2480B::w1_write_byte(uint8_t byte)
+{
+    if (!pullupArmed)
+    {
+        uint8_t response;
+        if (touchBlock(&byte, &response, 1) != 0)
+        {
+            w1_log("Could not write W1 byte\n");
+            return -1;
+        }
+        return 0;
+    }
+
+    // the pullup can only be primed on a bit command, so the byte is sent
+    // as 8 bits in one transfer with the last one primed
+    if (commandMode() != 0)
+    {
+        return -1;
+    }
+
+    uint8_t cmd[8];
+    uint8_t response[8];
+    for (int i = 0; i < 8; i++)
+    {
+        cmd[i] = DS2480B_CMD_COMM | DS2480B_FUNC_BIT | speedBits()
+                | ((byte >> i) & 1 ? DS2480B_BIT_ONE : 0);
+    }
+    cmd[7] |= DS2480B_PRIME_PULLUP;
+
+    pullupArmed = false;
+    if (transfer(cmd, 8, response, 8) != 0)
+    {
+        w1_log("Could not write W1 byte with strong pullup\n");
+        return -1;
+    }
+    pulseActive = true;
+
+    return 0;
+}
+
+int DS2480B::w1_read_byte()
+{
+    uint8_t out = 0xFF;
+    uint8_t in;
+    if (touchBlock(&out, &in, 1) != 0)
+    {
+        w1_log("Could not read W1 byte\n");
+        return -1;
+    }
+
+    return in;
+}
+
+int DS2480B::w1_read_block(uint8_t *buf, int len)
+{
+    memset(buf, 0xFF, len);
+    if (touchBlock(buf, buf, len) != 0)
+    {
+        w1_log("Could not read W1 block\n");
+        return -1;
+    }
+
+    return len;
+}
+
+int DS2480B::w1_write_block(uint8_t *buf, int len)
+{
+    if (pullupArmed)
+    {
+        // only the last byte gets the pullup
+        if (len > 1)
+        {
+            pullupArmed = false;
+            int ret = w1_write_block(buf, len - 1);
+            pullupArmed = true;
+            if (ret != 0)
+            {
+                return -1;
+            }
+        }
+        return len > 0 ? w1_write_byte(buf[len - 1]) : 0;
+    }
+
+    uint8_t response[DS2480B_MAX_BLOCK];
+    while (len > 0)
+    {
+        int chunk = len > DS2480B_MAX_BLOCK ? DS2480B_MAX_BLOCK : len;
+        if (touchBlock(buf, response, chunk) != 0)
+        {
+            w1_log("Could not write W1 block\n");
+            return -1;
+        }
+        buf += chunk;
+        len -= chunk;
+    }
+
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+// W1 search protocol
+//------------------------------------------------------------------------------
+int DS2480B::w1_search_lowlevel(w1_search_s *s)
+{
+    int ret = w1_reset();
+    if (ret < 0)
+    {
+        w1_log("Could not reset w1 bus\n");
+        s->reset();
+        return -1;
+    }
+    if (ret == 0)
+    {
+        // no presence pulse
+        return 0;
+    }
+
+    if (w1_write_byte(W1_CMD_SEARCH_ROM) != 0 || commandMode() != 0)
+    {
+        w1_log("Could not write search command\n");
+        s->reset();
+        return -1;
+    }
+
+    // the accelerator takes the preferred direction of every bit in the odd
+    // bits and returns the discrepancy flag and the chosen bit per id bit
+    uint8_t path[16] = { 0 };
+    for (int cur_bit = 0; cur_bit < 64; cur_bit++)
+    {
+        int dir;
+        if (cur_bit < s->start_search_from)
+        {
+            dir = s->last_device & (1ULL << cur_bit) ? 1 : 0;
+        } else {
+            dir = cur_bit == s->start_search_from ? 1 : 0;
+        }
+        if (dir)
+        {
+            path[cur_bit / 4] |= 1 << ((cur_bit % 4) * 2 + 1);
+        }
+    }
+
+    uint8_t on = DS2480B_CMD_COMM | DS2480B_FUNC_SEARCH_ON | speedBits();
+    uint8_t off[2] = {
+        DS2480B_MODE_COMMAND,
+        (uint8_t) (DS2480B_CMD_COMM | DS2480B_FUNC_SEARCH_OFF | speedBits())
+    };
+    uint8_t result[16];
+    if (transfer(&on, 1, NULL, 0) != 0 || touchBlock(path, result, 16) != 0
+            || transfer(off, 2, NULL, 0) != 0)
+    {
+        w1_log("Could not run accelerated search\n");
+        dataModeActive = false;
+        s->reset();
+        return -1;
+    }
+    dataModeActive = false;
+
+    uint64_t device = 0;
+    int last_zero = -1;
+    for (int cur_bit = 0; cur_bit < 64; cur_bit++)
+    {
+        int flags = result[cur_bit / 4] >> ((cur_bit % 4) * 2);
+        if (flags & 2)
+        {
+            device |= 1ULL << cur_bit;
+        } else if (flags & 1) {
+            // discrepancy found
+            last_zero = cur_bit;
+        }
+    }
+
+    if (device == ~0ULL)
+    {
+        // nobody answered the search
+        s->reset();
+        return 0;
+    }
+
+    if (!w1_check_rom_crc(device))
+    {
+        w1_log("Invalid crc\n");
+        s->reset();
+        return -1;
+    }
+
+    s->last_device = device;
+    s->start_search_from = last_zero;
+
+    return last_zero == -1 ? 2 : 1;
+}
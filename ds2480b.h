@@ -0,0 +1,107 @@
+#pragma once
+
+#include <QString>
+
+#include <stdint.h>
+
+#include "w1bridge.h"
+
+// mode switches, only valid as the first byte of a command or data run
+#define DS2480B_MODE_DATA       0xE1
+#define DS2480B_MODE_COMMAND    0xE3
+#define DS2480B_MODE_STOP_PULSE 0xF1
+
+// communication commands
+#define DS2480B_CMD_COMM        0x81
+#define DS2480B_FUNC_BIT        0x00
+#define DS2480B_FUNC_SEARCH_OFF 0x20
+#define DS2480B_FUNC_SEARCH_ON  0x30
+#define DS2480B_FUNC_RESET      0x40
+#define DS2480B_FUNC_CHMOD      0x60
+#define DS2480B_FUNC_MASK       0x60
+#define DS2480B_BIT_ONE         0x10
+#define DS2480B_SPEED_STANDARD  0x00
+#define DS2480B_SPEED_FLEX      0x04
+#define DS2480B_SPEED_OVERDRIVE 0x08
+#define DS2480B_SPEED_PULSE     0x0C
+#define DS2480B_SPEED_MASK      0x0C
+#define DS2480B_PRIME_PULLUP    0x02
+
+// reset response
+#define DS2480B_RESET_MASK      0x03
+#define DS2480B_RESET_SHORT     0x00
+#define DS2480B_RESET_PRESENCE  0x01
+#define DS2480B_RESET_ALARM     0x02
+#define DS2480B_RESET_NONE      0x03
+
+// configuration commands, parameter in bits 4-6, value in bits 1-3
+#define DS2480B_CMD_CONFIG      0x01
+#define DS2480B_PARAM_SLEW      0x10
+#define DS2480B_PARAM_PULLUP    0x30
+#define DS2480B_PARAM_WRITE1    0x40
+#define DS2480B_PARAM_SAMPLE    0x50
+#define DS2480B_PARAM_BAUD      0x70
+#define DS2480B_SLEW_1V37       0x06
+#define DS2480B_WRITE1_10US     0x04
+#define DS2480B_SAMPLE_8US      0x0A
+#define DS2480B_PULLUP_INFINITE 0x0E
+#define DS2480B_BAUD_9600       0x00
+
+#define DS2480B_TIMEOUT_MS      200
+#define DS2480B_MAX_BLOCK       128
+
+/*!
+ * \class DS2480B
+ *
+ * \brief 1-wire master on a DS2480B serial bridge
+ *
+ * Block transfers are sent in data mode as one serial write, so a block
+ * costs one round trip instead of a command and status poll per byte. The
+ * search uses the search accelerator, which resolves a whole id per round
+ * trip. Standard speed runs with flexible speed timing (1.37 V/us slew,
+ * 10 us write-1 low time, 8 us sample offset) for long lines.
+ */
+class DS2480B : public W1Bridge
+{
+public:
+    DS2480B();
+    ~DS2480B();
+
+    /*!
+     * \brief open - opens the serial port and detects the DS2480B
+     * \param deviceFile - tty the bridge is connected to, for example "/dev/ttyUSB0"
+     * \return 0 on success, -1 on failure
+     */
+    int open(QString deviceFile);
+    void close();
+
+    int set_active_pullup(bool activePullup) override;
+    int set_high_speed(bool highSpeed) override;
+    int set_strong_pullup(bool strongPullup) override;
+
+    int w1_reset() override;
+    int w1_read_bit() override;
+    int w1_write_bit(bit_t bit) override;
+    int w1_write_byte(uint8_t byte) override;
+    int w1_read_byte() override;
+    int w1_read_block(uint8_t *buf, int len) override;
+    int w1_write_block(uint8_t *buf, int len) override;
+
+protected:
+    int w1_search_lowlevel(w1_search_s *s) override;
+
+private:
+    int detect();
+    int commandMode();
+    int dataMode();
+    int transfer(const uint8_t *out, int outLen, uint8_t *in, int inLen);
+    int touchBlock(const uint8_t *out, uint8_t *in, int len);
+    int bitCommand(int bit);
+    uint8_t speedBits() const;
+
+    int fd = -1;
+    bool dataModeActive = false;
+    bool highSpeed = false;
+    bool pullupArmed = false;
+    bool pulseActive = false;
+};
@@ -0,0 +1,262 @@
+#include "ds2480bsim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "ds2480b.h"
+
+DS2480BSimulator::DS2480BSimulator(W1SimBus &_bus)
+    : bus(_bus), stopRequested(false), received(0)
+{
+    memset(config, 0, sizeof(config));
+}
+
+DS2480BSimulator::~DS2480BSimulator()
+{
+    stop();
+}
+
+int DS2480BSimulator::start()
+{
+    master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+    {
+        fprintf(stderr, "Could not create pseudo terminal: %m\n");
+        stop();
+        return -1;
+    }
+
+    slavePath = ptsname(master);
+
+    // keep the slave open, the master would see a hangup between two
+    // sessions of the backend otherwise
+    slave = ::open(slavePath.toLocal8Bit().constData(), O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (slave < 0)
+    {
+        fprintf(stderr, "Could not open %s: %m\n", slavePath.toLocal8Bit().constData());
+        stop();
+        return -1;
+    }
+
+    struct termios tio;
+    tcgetattr(master, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(master, TCSANOW, &tio);
+
+    stopRequested = false;
+    thread = std::thread([this] { run(); });
+
+    return 0;
+}
+
+void DS2480BSimulator::stop()
+{
+    stopRequested = true;
+    if (thread.joinable())
+    {
+        thread.join();
+    }
+
+    if (slave != -1)
+    {
+        ::close(slave);
+        slave = -1;
+    }
+    if (master != -1)
+    {
+        ::close(master);
+        master = -1;
+    }
+}
+
+void DS2480BSimulator::run()
+{
+    uint8_t buf[256];
+    QByteArray response;
+
+    while (!stopRequested)
+    {
+        struct pollfd pfd = { master, POLLIN, 0 };
+        if (poll(&pfd, 1, 100) <= 0)
+        {
+            continue;
+        }
+
+        int len = read(master, buf, sizeof(buf));
+        if (len <= 0)
+        {
+            continue;
+        }
+        received += len;
+
+        response.clear();
+        for (int i = 0; i < len; i++)
+        {
+            process(buf[i], &response);
+        }
+
+        int done = 0;
+        while (done < response.size())
+        {
+            int ret = write(master, response.constData() + done, response.size() - done);
+            if (ret < 0 && errno != EINTR)
+            {
+                break;
+            }
+            done += ret > 0 ? ret : 0;
+        }
+    }
+}
+
+void DS2480BSimulator::process(uint8_t byte, QByteArray *response)
+{
+    if (!calibrated)
+    {
+        // the first byte after power up sets the baud rate
+        calibrated = true;
+        return;
+    }
+
+    if (dataMode)
+    {
+        if (escape)
+        {
+            escape = false;
+            if (byte != DS2480B_MODE_COMMAND)
+            {
+                // a single switch byte, this one is already a command
+                dataMode = false;
+                command(byte, response);
+                return;
+            }
+        } else if (byte == DS2480B_MODE_COMMAND) {
+            escape = true;
+            return;
+        }
+
+        data(byte, response);
+        return;
+    }
+
+    command(byte, response);
+}
+
+void DS2480BSimulator::command(uint8_t byte, QByteArray *response)
+{
+    if (byte == DS2480B_MODE_DATA)
+    {
+        dataMode = true;
+        return;
+    }
+    if (byte == DS2480B_MODE_COMMAND)
+    {
+        return;
+    }
+    if (byte == DS2480B_MODE_STOP_PULSE)
+    {
+        // ends a pulse, its speed bits are not a speed change
+        response->append((char) byte);
+        return;
+    }
+
+    if ((byte & 0x81) == DS2480B_CMD_CONFIG)
+    {
+        int param = (byte >> 4) & 7;
+        if (param == 0)
+        {
+            // read: parameter code in bits 1-3, answered with its value
+            response->append((char) (config[(byte >> 1) & 7] << 1));
+        } else {
+            config[param] = (byte >> 1) & 7;
+            response->append((char) (byte & ~1));
+        }
+        return;
+    }
+
+    if ((byte & DS2480B_CMD_COMM) != DS2480B_CMD_COMM)
+    {
+        return;
+    }
+
+    int speed = byte & DS2480B_SPEED_MASK;
+    if (speed != DS2480B_SPEED_PULSE)
+    {
+        bus.setOverdrive(speed == DS2480B_SPEED_OVERDRIVE);
+    }
+
+    switch (byte & DS2480B_FUNC_MASK)
+    {
+    case DS2480B_FUNC_RESET:
+        response->append((char) (0xCC | (bus.reset() ? DS2480B_RESET_PRESENCE
+                                                     : DS2480B_RESET_NONE)));
+        break;
+    case DS2480B_FUNC_BIT:
+    {
+        int bit = bus.touchBit(byte & DS2480B_BIT_ONE ? 1 : 0);
+        response->append((char) ((byte & 0xFC) | (bit ? 0x03 : 0x00)));
+        break;
+    }
+    case DS2480B_FUNC_SEARCH_OFF:
+        // also DS2480B_FUNC_SEARCH_ON, told apart by the polarity bit
+        searchMode = byte & DS2480B_BIT_ONE;
+        searchLen = 0;
+        break;
+    case DS2480B_FUNC_CHMOD:
+        // pulse and stop pulse, the pullup itself is not simulated
+        response->append((char) byte);
+        break;
+    }
+}
+
+void DS2480BSimulator::data(uint8_t byte, QByteArray *response)
+{
+    if (!searchMode)
+    {
+        response->append((char) bus.touchByte(byte));
+        return;
+    }
+
+    searchPath[searchLen++] = byte;
+    if (searchLen == 16)
+    {
+        search(response);
+        searchLen = 0;
+    }
+}
+
+void DS2480BSimulator::search(QByteArray *response)
+{
+    uint8_t result[16];
+    memset(result, 0, sizeof(result));
+
+    for (int i = 0; i < 64; i++)
+    {
+        int shift = (i % 4) * 2;
+        int first = bus.touchBit(1);
+        int second = bus.touchBit(1);
+
+        int discrepancy;
+        int dir;
+        if (first != second)
+        {
+            discrepancy = 0;
+            dir = first;
+        } else {
+            // both values present takes the requested path, nobody left reads 1
+            discrepancy = 1;
+            dir = first ? 1 : (searchPath[i / 4] >> (shift + 1)) & 1;
+        }
+
+        bus.touchBit(dir);
+        result[i / 4] |= (discrepancy | (dir << 1)) << shift;
+    }
+
+    response->append((const char *) result, sizeof(result));
+}
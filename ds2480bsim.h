@@ -0,0 +1,61 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+
+#include <stdint.h>
+
+#include <atomic>
+#include <thread>
+
+#include "w1simbus.h"
+
+/*!
+ * \class DS2480BSimulator
+ *
+ * \brief DS2480B on a pseudo terminal, driving a W1SimBus
+ *
+ * Implements the command and data modes, the communication commands
+ * (reset, single bit, search accelerator, strong pullup) and the
+ * configuration parameters closely enough to run the DS2480B backend
+ * against simulated devices. The bridge is opened with devicePath().
+ */
+class DS2480BSimulator
+{
+public:
+    DS2480BSimulator(W1SimBus &bus);
+    ~DS2480BSimulator();
+
+    /*!
+     * \brief start - creates the pseudo terminal and starts serving it
+     * \return 0 on success, -1 on failure
+     */
+    int start();
+    void stop();
+
+    QString devicePath() const { return slavePath; }
+    uint64_t bytesReceived() const { return received; }
+
+private:
+    void run();
+    void process(uint8_t byte, QByteArray *response);
+    void command(uint8_t byte, QByteArray *response);
+    void data(uint8_t byte, QByteArray *response);
+    void search(QByteArray *response);
+
+    W1SimBus &bus;
+    int master = -1;
+    int slave = -1;
+    QString slavePath;
+    std::thread thread;
+    std::atomic<bool> stopRequested;
+    std::atomic<uint64_t> received;
+
+    bool calibrated = false;
+    bool dataMode = false;
+    bool escape = false;
+    bool searchMode = false;
+    uint8_t searchPath[16];
+    int searchLen = 0;
+    uint8_t config[8];
+};
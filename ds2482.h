@@ -3,6 +3,9 @@
 #include <QList>
 #include <QString>
 
+#include "i2ctrace.h"
+#include "w1bridge.h"
+
 #define DS2482_STS_1WB_MASK 1
 #define DS2482_STS_PPD_MASK (1 << 1)
 #define DS2482_STS_SD_MASK  (1 << 2)
@@ -18,6 +21,12 @@
 
 #define DS2482_IDLE_TIMEOUT 100
 
+// nominal duration of 1-wire operations at standard and overdrive speed
+#define DS2482_RESET_US    1250
+#define DS2482_RESET_OD_US 150
+#define DS2482_SLOT_US     70
+#define DS2482_SLOT_OD_US  11
+
 
 
 /*!
@@ -25,7 +34,7 @@
  *
  * \brief Simple userland interface to the DS2482 i2c/one wire master
  */
-class DS2482
+class DS2482 : public W1Bridge
 {
 public:
     DS2482();
@@ -49,23 +58,6 @@ public:
         DS2482_CMD_W1_TRIPLET     = 0x78
     };
 
-    enum w1_cmd_t {
-        W1_CMD_SEARCH_ROM =          0xF0,
-        W1_CMD_READ_ROM =            0x33,
-        W1_CMD_MATCH_ROM =           0x55,
-        W1_CMD_SKIP_ROM =            0xCC,
-        W1_CMD_RESUME =              0xA5,
-        W1_CMD_OVERDRIVE_SKIP_ROM =  0x3C,
-        W1_CMD_OVERDRIVE_MATCH_ROM = 0x69
-    };
-
-    enum ds2431_cmd_t {
-        DS2431_CMD_WRITE_SCRATCHPAD = 0x0F,
-        DS2431_CMD_READ_SCRATCHPAD  = 0xAA,
-        DS2431_CMD_COPY_SCRATCHPAD  = 0x55,
-        DS2431_CMD_READ_MEMORY      = 0xF0
-    };
-
     /*!
      * \brief open - opens the i2c bus and selects the ds2482 slave
      * \param deviceFile - i2c device file, for example "/dev/i2c-2"
@@ -73,19 +65,38 @@ public:
      * \return 0 on success, -1 on failure
      */
     int open(QString deviceFile, uint8_t address);
+    /*!
+     * \brief open - uses an alternative transport instead of an i2c device,
+     * for example an I2CTraceReplay
+     * \param transport - transport, not owned
+     * \return 0 on success, -1 on failure
+     */
+    int open(I2CTransport *transport);
     /*!
      * \brief close the opened i2c device (if open)
      */
     void close();
 
-    //------------------------------------------------------------------------------
-    // W1 search protocol
-    //------------------------------------------------------------------------------
     /*!
-     * \brief findDevices - scans the 1-wire bus and returns found device ids
-     * \return list of found device ids
+     * \brief setRecorder - records every following I2C operation
+     * \param recorder - open recorder, not owned, nullptr stops recording
+     */
+    void setRecorder(I2CTraceRecorder *recorder);
+
+    /*!
+     * \brief bridge usage since open, see DS2482Bus for the per client share
      */
-    QList<uint64_t> findDevices();
+    struct usage_t {
+        // successful transfers, a command that was not accepted costs no bus time
+        uint64_t i2cOps;
+        // status reads while waiting for the 1-wire bus and the time they took
+        uint64_t idlePolls;
+        uint64_t idleUs;
+        // 1-wire time of the issued commands, modelled from the speed bit
+        uint64_t slotUs;
+    };
+
+    usage_t usage() const { return usageCounters; }
 
     //------------------------------------------------------------------------------
     // DS2482 control
@@ -97,61 +108,69 @@ public:
      */
     int select_register(ds2482_reg_t read_ptr);
     int reset();
+    /*!
+     * \brief select_channel - selects the active 1-wire channel (DS2482-800 only)
+     * \param channel - channel 0 to 7
+     * \return 0 on success, -1 on failure
+     */
+    int select_channel(int channel);
     int wait_w1_idle();
 
     typedef uint8_t ds2482_config_t;
-    typedef uint8_t bit_t;
 
     int set_config(uint8_t config);
-    int set_active_pullup(bool activePullup);
-    int set_high_speed(bool highSpeed);
-    int set_strong_pullup(bool strongPullup);
+    int set_active_pullup(bool activePullup) override;
+    int set_high_speed(bool highSpeed) override;
+    int set_strong_pullup(bool strongPullup) override;
 
     //------------------------------------------------------------------------------
     // W1 primitives
     //------------------------------------------------------------------------------
-    /*!
-     * \brief w1_reset
-     * \return 1 if presence pulse was detected, 0 when no presence pulse was detected, -1 on error
-     */
-    int w1_reset();
-    int w1_read_bit();
-    int w1_write_bit(bit_t bit);
-
-    int w1_read_block(uint8_t *buf, int len);
-    int w1_write_block(uint8_t *buf, int len);
+    int w1_reset() override;
+    int w1_read_bit() override;
+    int w1_write_bit(bit_t bit) override;
+    int w1_write_byte(uint8_t byte) override;
+    int w1_read_byte() override;
+    int w1_triplet(bit_t *dir, bit_t *first_bit, bit_t *second_bit) override;
 
+    //------------------------------------------------------------------------------
+    // Split-phase primitives, see DS2482Async
+    //------------------------------------------------------------------------------
     /*!
-     * \brief w1_write_byte
-     * \param byte - byte to be written
+     * \brief w1_start - issues a 1-wire command without waiting for the bus,
+     * the chip leaves its read pointer on the status register
+     * \param cmd - W1 reset, single bit, write byte, read byte or triplet
+     * \param data - parameter byte, -1 for commands without one
      * \return 0 on success, -1 on failure
      */
-    int w1_write_byte(uint8_t byte);
+    int w1_start(ds2482_cmd_t cmd, int data = -1);
     /*!
-     * \brief w1_read_byte
-     * \return the byte on success, -1 on failure
+     * \brief read_status - reads the register the read pointer is on, the
+     * status register after w1_start()
+     * \return status byte, -1 on failure
      */
-    int w1_read_byte();
-
-    int w1_triplet(bit_t *dir, bit_t *first_bit, bit_t *second_bit);
-
-    //------------------------------------------------------------------------------
-    // W1 ROM commands
-    //------------------------------------------------------------------------------
-    int w1_match_rom(uint64_t device);
-    int w1_read_rom(uint64_t *device);
-    int w1_skip_rom();
-    int w1_resume();
-    int w1_overdrive_match_rom(uint64_t device);
-    int w1_overdrive_skip_rom();
-
-    static bool w1_check_rom_crc(uint64_t dev);
-    static uint16_t w1_compute_data_crc(uint8_t *buf, int len);
+    int read_status();
+    /*!
+     * \brief read_data - reads the byte received by W1 read byte
+     * \return the byte, -1 on failure
+     */
+    int read_data();
+    bool high_speed() const { return config & DS2482_REG_1WS_MASK; }
+    /*!
+     * \brief w1_duration_us - nominal duration of a 1-wire command at the current speed
+     * \return duration in us, 0 for commands that do not use the 1-wire bus
+     */
+    int w1_duration_us(ds2482_cmd_t cmd) const;
 
 private:
-    struct w1_search_s;
+    int i2c_write_byte(uint8_t value);
+    int i2c_write_byte_data(uint8_t cmd, uint8_t value);
+    int i2c_read_byte();
+    void account_command(uint8_t cmd);
 
-    int w1_search_lowlevel(w1_search_s *s);
     int fd = -1;
+    I2CTransport *transport = nullptr;
+    I2CTraceRecorder *recorder = nullptr;
     int config = 0;
+    usage_t usageCounters = {};
 };
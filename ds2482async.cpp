@@ -0,0 +1,232 @@
+#include "ds2482async.h"
+
+DS2482Async::DS2482Async(DS2482 &_ds, W1Executor &_executor)
+    : ds(_ds), exec(_executor), lock(_executor)
+{
+
+}
+
+W1Task<int> DS2482Async::wait_idle(int expectedUs)
+{
+    if (expectedUs > 0)
+    {
+        co_await exec.sleep(expectedUs);
+    }
+
+    for (int retries = 0; retries < DS2482_IDLE_TIMEOUT; retries++)
+    {
+        int status = ds.read_status();
+        if (status < 0)
+        {
+            co_return -1;
+        }
+        if (!(status & DS2482_STS_1WB_MASK))
+        {
+            co_return status;
+        }
+
+        co_await exec.sleep(DS2482ASYNC_POLL_US);
+    }
+
+    co_return -1;
+}
+
+W1Task<int> DS2482Async::command(DS2482::ds2482_cmd_t cmd, int data)
+{
+    // the previous operation left the bus idle
+    if (ds.w1_start(cmd, data) != 0)
+    {
+        co_return -1;
+    }
+
+    co_return co_await wait_idle(ds.w1_duration_us(cmd));
+}
+
+//------------------------------------------------------------------------------
+// W1 primitives
+//------------------------------------------------------------------------------
+W1Task<int> DS2482Async::w1_reset()
+{
+    int status = co_await command(DS2482::DS2482_CMD_W1_RESET);
+    if (status < 0)
+    {
+        co_return -1;
+    }
+
+    co_return status & DS2482_STS_PPD_MASK ? 1 : 0;
+}
+
+W1Task<int> DS2482Async::w1_read_bit()
+{
+    int status = co_await command(DS2482::DS2482_CMD_W1_SINGLE_BIT, 0xFF);
+    if (status < 0)
+    {
+        co_return -1;
+    }
+
+    co_return status & DS2482_STS_SBR_MASK ? 1 : 0;
+}
+
+W1Task<int> DS2482Async::w1_write_bit(W1Bridge::bit_t bit)
+{
+    int status = co_await command(DS2482::DS2482_CMD_W1_SINGLE_BIT, bit == 0 ? 0x7F : 0xFF);
+    co_return status < 0 ? -1 : 0;
+}
+
+W1Task<int> DS2482Async::w1_write_byte(uint8_t byte)
+{
+    int status = co_await command(DS2482::DS2482_CMD_W1_WRITE_BYTE, byte);
+    co_return status < 0 ? -1 : 0;
+}
+
+W1Task<int> DS2482Async::w1_read_byte()
+{
+    int status = co_await command(DS2482::DS2482_CMD_W1_READ_BYTE);
+    if (status < 0)
+    {
+        co_return -1;
+    }
+
+    co_return ds.read_data();
+}
+
+W1Task<int> DS2482Async::w1_triplet(W1Bridge::bit_t *dir, W1Bridge::bit_t *first_bit,
+                                    W1Bridge::bit_t *second_bit)
+{
+    int status = co_await command(DS2482::DS2482_CMD_W1_TRIPLET, *dir ? 0xFF : 0);
+    if (status < 0)
+    {
+        co_return -1;
+    }
+
+    *first_bit = status & DS2482_STS_SBR_MASK ? 1 : 0;
+    *second_bit = status & DS2482_STS_TSB_MASK ? 1 : 0;
+    *dir = status & DS2482_STS_DIR_MASK ? 1 : 0;
+
+    co_return 0;
+}
+
+W1Task<int> DS2482Async::w1_read_block(uint8_t *buf, int len)
+{
+    for (int i = 0; i < len; i++)
+    {
+        int ret = co_await w1_read_byte();
+        if (ret < 0)
+        {
+            co_return -1;
+        }
+        buf[i] = ret;
+    }
+
+    co_return len;
+}
+
+W1Task<int> DS2482Async::w1_write_block(const uint8_t *buf, int len)
+{
+    for (int i = 0; i < len; i++)
+    {
+        int ret = co_await w1_write_byte(buf[i]);
+        if (ret != 0)
+        {
+            co_return -1;
+        }
+    }
+
+    co_return 0;
+}
+
+W1Task<int> DS2482Async::w1_write_byte_pullup(uint8_t byte, int holdUs)
+{
+    // the strong pullup takes over after the last bit of the next byte
+    if (ds.set_strong_pullup(true) != 0)
+    {
+        co_return -1;
+    }
+
+    int ret = co_await w1_write_byte(byte);
+    if (ret == 0)
+    {
+        co_await exec.sleep(holdUs);
+    }
+
+    if (ds.set_strong_pullup(false) != 0)
+    {
+        co_return -1;
+    }
+
+    co_return ret;
+}
+
+//------------------------------------------------------------------------------
+// W1 ROM commands
+//------------------------------------------------------------------------------
+W1Task<int> DS2482Async::w1_match_rom(uint64_t device)
+{
+    int present = co_await w1_reset();
+    if (present < 0)
+    {
+        co_return -1;
+    }
+
+    uint8_t data[1 + 8];
+    data[0] = W1Bridge::W1_CMD_MATCH_ROM;
+    for (int i = 0; i < 8; i++)
+    {
+        data[i + 1] = device & 0xFF;
+        device >>= 8;
+    }
+
+    co_return co_await w1_write_block(data, sizeof(data));
+}
+
+W1Task<int> DS2482Async::w1_skip_rom()
+{
+    int present = co_await w1_reset();
+    if (present < 0)
+    {
+        co_return -1;
+    }
+
+    co_return co_await w1_write_byte(W1Bridge::W1_CMD_SKIP_ROM);
+}
+
+W1Task<int> DS2482Async::w1_resume()
+{
+    int present = co_await w1_reset();
+    if (present < 0)
+    {
+        co_return -1;
+    }
+
+    co_return co_await w1_write_byte(W1Bridge::W1_CMD_RESUME);
+}
+
+//------------------------------------------------------------------------------
+// DS2431 memory
+//------------------------------------------------------------------------------
+W1Task<int> DS2482Async::ds2431_read_memory(uint64_t device, int address, uint8_t *buf, int len)
+{
+    if (address < 0 || len < 0 || address + len > DS2431_MEMORY_SIZE)
+    {
+        co_return -1;
+    }
+
+    int ret = co_await w1_match_rom(device);
+    if (ret != 0)
+    {
+        co_return -1;
+    }
+
+    uint8_t cmd[3] = {
+        W1Bridge::DS2431_CMD_READ_MEMORY,
+        (uint8_t) (address & 0xFF),
+        (uint8_t) (address >> 8)
+    };
+    ret = co_await w1_write_block(cmd, sizeof(cmd));
+    if (ret != 0)
+    {
+        co_return -1;
+    }
+
+    co_return co_await w1_read_block(buf, len);
+}
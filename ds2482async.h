@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "ds2482.h"
+#include "w1executor.h"
+#include "w1task.h"
+
+// pause between two status polls while the bus is still busy
+#define DS2482ASYNC_POLL_US      50
+
+/*!
+ * \class DS2482Async
+ *
+ * \brief Coroutine versions of the DS2482 primitives
+ *
+ * Every 1-wire command is issued with DS2482::w1_start(). The coroutine
+ * then sleeps on the executor for the nominal duration of the operation
+ * (DS2482::w1_duration_us()) and polls the status until the bus is idle,
+ * instead of spinning on the status register. Like the blocking
+ * primitives, every operation ends with an idle bus.
+ *
+ * A transaction (reset, ROM selection, data phase) must not be interleaved
+ * with another coroutine on the same bridge; hold the guard from acquire()
+ * for its whole duration:
+ *
+ *   W1AsyncLock::Guard guard = co_await bus.acquire();
+ *   co_await bus.w1_match_rom(rom);
+ */
+class DS2482Async
+{
+public:
+    DS2482Async(DS2482 &ds, W1Executor &executor);
+
+    DS2482 &bridge() { return ds; }
+    W1Executor &executor() { return exec; }
+
+    W1AsyncLock::acquire_awaiter acquire() { return lock.acquire(); }
+
+    /*!
+     * \brief wait_idle - waits until the 1-wire bus is idle
+     * \param expectedUs - time the running operation needs at least
+     * \return status byte on success, -1 on failure or timeout
+     */
+    W1Task<int> wait_idle(int expectedUs = 0);
+
+    /*!
+     * \return 1 if presence pulse was detected, 0 when no presence pulse was detected, -1 on error
+     */
+    W1Task<int> w1_reset();
+    W1Task<int> w1_read_bit();
+    W1Task<int> w1_write_bit(W1Bridge::bit_t bit);
+    W1Task<int> w1_write_byte(uint8_t byte);
+    W1Task<int> w1_read_byte();
+    W1Task<int> w1_triplet(W1Bridge::bit_t *dir, W1Bridge::bit_t *first_bit,
+                           W1Bridge::bit_t *second_bit);
+    /*!
+     * \return len on success, -1 on failure
+     */
+    W1Task<int> w1_read_block(uint8_t *buf, int len);
+    W1Task<int> w1_write_block(const uint8_t *buf, int len);
+
+    W1Task<int> w1_match_rom(uint64_t device);
+    W1Task<int> w1_skip_rom();
+    W1Task<int> w1_resume();
+
+    /*!
+     * \brief w1_write_byte_pullup - writes a byte and powers the bus with the
+     * strong pullup for holdUs, e.g. for a copy scratchpad or a conversion
+     * \return 0 on success, -1 on failure
+     */
+    W1Task<int> w1_write_byte_pullup(uint8_t byte, int holdUs);
+
+    /*!
+     * \brief ds2431_read_memory - selects the device and reads its memory
+     * \return len on success, -1 on failure
+     */
+    W1Task<int> ds2431_read_memory(uint64_t device, int address, uint8_t *buf, int len);
+
+private:
+    W1Task<int> command(DS2482::ds2482_cmd_t cmd, int data = -1);
+
+    DS2482 &ds;
+    W1Executor &exec;
+    W1AsyncLock lock;
+};
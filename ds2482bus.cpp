@@ -0,0 +1,302 @@
+#include "ds2482bus.h"
+
+#include <unistd.h>
+
+#include "w1clock.h"
+
+struct DS2482Bus::waiter_s {
+    std::condition_variable cond;
+    int client = DS2482BUS_DEFAULT_CLIENT;
+    bool granted = false;
+    waiter_s *next = nullptr;
+};
+
+DS2482Bus::DS2482Bus(DS2482 &_ds)
+    : ds(_ds)
+{
+    addClient("default");
+}
+
+//------------------------------------------------------------------------------
+// Clients
+//------------------------------------------------------------------------------
+int DS2482Bus::addClient(const QString &name, int weight)
+{
+    if (weight < 1)
+    {
+        fprintf(stderr, "Invalid weight %d for bus client %s\n", weight, qPrintable(name));
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    client_s c = {};
+    c.stats.name = name;
+    c.stats.weight = weight;
+    // start with the others instead of owning the bus until it caught up
+    c.virtualUs = virtualUs;
+    clientList.append(c);
+
+    return clientList.size() - 1;
+}
+
+int DS2482Bus::setWeight(int client, int weight)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (client < 0 || client >= clientList.size() || weight < 1)
+    {
+        fprintf(stderr, "Invalid weight %d for bus client %d\n", weight, client);
+        return -1;
+    }
+
+    clientList[client].stats.weight = weight;
+
+    return 0;
+}
+
+int DS2482Bus::setRateLimit(int client, int usPerSecond, int burstUs)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (client < 0 || client >= clientList.size() || usPerSecond < 0
+            || (usPerSecond > 0 && burstUs <= 0))
+    {
+        fprintf(stderr, "Invalid rate limit %d us/s, burst %d us for bus client %d\n",
+                usPerSecond, burstUs, client);
+        return -1;
+    }
+
+    client_s &c = clientList[client];
+    c.rate = usPerSecond;
+    c.burst = burstUs;
+    c.tokens = burstUs;
+    c.refilledUs = w1_now_us();
+
+    return 0;
+}
+
+void DS2482Bus::refill(client_s &c, int64_t now)
+{
+    if (c.rate == 0)
+    {
+        return;
+    }
+
+    c.tokens += (double) (now - c.refilledUs) * c.rate / 1000000;
+    if (c.tokens > c.burst)
+    {
+        c.tokens = c.burst;
+    }
+    c.refilledUs = now;
+}
+
+//------------------------------------------------------------------------------
+// Ownership
+//------------------------------------------------------------------------------
+void DS2482Bus::acquire(int client)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    if (client < 0 || client >= clientList.size())
+    {
+        fprintf(stderr, "Unknown bus client %d\n", client);
+        client = DS2482BUS_DEFAULT_CLIENT;
+    }
+
+    // over the rate limit, wait outside of the queue until the bucket refilled
+    for (;;)
+    {
+        int64_t now = w1_now_us();
+        client_s &c = clientList[client];
+        refill(c, now);
+        if (c.rate == 0 || c.tokens >= 0)
+        {
+            break;
+        }
+
+        int64_t delayUs = (int64_t) (-c.tokens * 1000000 / c.rate) + 1;
+        lock.unlock();
+        usleep(delayUs);
+        lock.lock();
+        clientList[client].stats.throttledUs += w1_now_us() - now;
+    }
+
+    client_s &c = clientList[client];
+    if (c.virtualUs < virtualUs)
+    {
+        c.virtualUs = virtualUs;
+    }
+
+    int64_t queuedUs = w1_now_us();
+    if (!busy)
+    {
+        busy = true;
+        grant(client, queuedUs);
+        return;
+    }
+
+    // waiter lives on our stack until the bus was handed to us
+    waiter_s waiter;
+    waiter.client = client;
+    if (tail != nullptr)
+    {
+        tail->next = &waiter;
+    } else {
+        head = &waiter;
+    }
+    tail = &waiter;
+
+    waiter.cond.wait(lock, [&waiter] { return waiter.granted; });
+    clientList[client].stats.waitUs += grantedUs - queuedUs;
+}
+
+void DS2482Bus::grant(int client, int64_t now)
+{
+    owner = client;
+    grantedUs = now;
+    grantedUsage = ds.usage();
+    if (virtualUs < clientList[client].virtualUs)
+    {
+        virtualUs = clientList[client].virtualUs;
+    }
+}
+
+void DS2482Bus::release()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // charge the owner
+    int64_t now = w1_now_us();
+    int64_t heldUs = now - grantedUs;
+    DS2482::usage_t usage = ds.usage();
+    client_s &c = clientList[owner];
+
+    c.stats.transactions++;
+    c.stats.holdUs += heldUs;
+    c.stats.usage.i2cOps += usage.i2cOps - grantedUsage.i2cOps;
+    c.stats.usage.idlePolls += usage.idlePolls - grantedUsage.idlePolls;
+    c.stats.usage.idleUs += usage.idleUs - grantedUsage.idleUs;
+    c.stats.usage.slotUs += usage.slotUs - grantedUsage.slotUs;
+    c.virtualUs += (double) heldUs / c.stats.weight;
+    if (c.rate > 0)
+    {
+        refill(c, now);
+        c.tokens -= heldUs;
+    }
+
+    if (head == nullptr)
+    {
+        busy = false;
+        return;
+    }
+
+    // hand over to the waiter with the least weighted bus time, the first
+    // one on ties; busy stays set
+    waiter_s *prev = nullptr;
+    waiter_s *bestPrev = nullptr;
+    waiter_s *best = head;
+    for (waiter_s *w = head; w != nullptr; prev = w, w = w->next)
+    {
+        if (clientList[w->client].virtualUs < clientList[best->client].virtualUs)
+        {
+            best = w;
+            bestPrev = prev;
+        }
+    }
+
+    if (bestPrev != nullptr)
+    {
+        bestPrev->next = best->next;
+    } else {
+        head = best->next;
+    }
+    if (tail == best)
+    {
+        tail = bestPrev;
+    }
+
+    grant(best->client, now);
+    best->granted = true;
+    best->cond.notify_one();
+}
+
+int DS2482Bus::transact(std::function<int(DS2482 &)> fn, int client)
+{
+    Transaction t(*this, client);
+    return fn(t.ds());
+}
+
+//------------------------------------------------------------------------------
+// Accounting
+//------------------------------------------------------------------------------
+int DS2482Bus::clients() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return clientList.size();
+}
+
+DS2482Bus::client_stats_t DS2482Bus::stats(int client) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (client < 0 || client >= clientList.size())
+    {
+        return client_stats_t();
+    }
+
+    return clientList[client].stats;
+}
+
+void DS2482Bus::resetStats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (int i = 0; i < clientList.size(); i++)
+    {
+        client_stats_t &s = clientList[i].stats;
+        client_stats_t cleared = {};
+        cleared.name = s.name;
+        cleared.weight = s.weight;
+        s = cleared;
+    }
+}
+
+void DS2482Bus::printReport(FILE *f) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    uint64_t totalUs = 0;
+    foreach (const client_s &c, clientList)
+    {
+        totalUs += c.stats.holdUs;
+    }
+
+    fprintf(f, "%-16s %6s %8s %9s %9s %9s %9s %8s %9s %9s %6s\n", "client", "weight",
+            "trans", "hold ms", "wait ms", "thrtl ms", "i2c ops", "polls", "idle ms",
+            "slot ms", "share");
+    foreach (const client_s &c, clientList)
+    {
+        const client_stats_t &s = c.stats;
+        fprintf(f, "%-16s %6d %8llu %9.1f %9.1f %9.1f %9llu %8llu %9.1f %9.1f %5.1f%%\n",
+                qPrintable(s.name), s.weight, (unsigned long long) s.transactions,
+                s.holdUs / 1000.0, s.waitUs / 1000.0, s.throttledUs / 1000.0,
+                (unsigned long long) s.usage.i2cOps, (unsigned long long) s.usage.idlePolls,
+                s.usage.idleUs / 1000.0, s.usage.slotUs / 1000.0,
+                totalUs > 0 ? s.holdUs * 100.0 / totalUs : 0.0);
+    }
+}
+
+//------------------------------------------------------------------------------
+// Transaction
+//------------------------------------------------------------------------------
+DS2482Bus::Transaction::Transaction(DS2482Bus &_bus, int client)
+    : bus(_bus)
+{
+    bus.acquire(client);
+}
+
+DS2482Bus::Transaction::~Transaction()
+{
+    bus.release();
+}
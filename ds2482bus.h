@@ -0,0 +1,139 @@
+#pragma once
+
+#include <QString>
+#include <QVector>
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+
+#include "ds2482.h"
+
+// client every transaction without an explicit one is charged to
+#define DS2482BUS_DEFAULT_CLIENT 0
+
+/*!
+ * \class DS2482Bus
+ *
+ * \brief Thread-safe front end sharing one DS2482 between several threads
+ *
+ * Ownership of the bridge is taken for a whole transaction (reset, ROM
+ * selection and data phase), so a RESUME or MATCH ROM sequence can not be
+ * broken up by another thread and the cached config byte stays consistent.
+ * Waiting threads are queued and the bus is handed over directly to the
+ * next one, only that thread is woken up.
+ *
+ * Transactions are charged to clients. A client is billed for the time it
+ * owns the bus, broken down into I2C operations, idle polls and modelled
+ * 1-wire time (DS2482::usage_t). When several clients wait, the bus goes to
+ * the one with the least owned time relative to its weight, so a client
+ * with weight 4 gets four times the bus time of one with weight 1 under
+ * load. A client that was idle starts at the current virtual time and can
+ * not save up credit. A client can additionally be rate limited with a
+ * token bucket on its owned time; it then waits before queueing and does
+ * not hold up the others.
+ */
+class DS2482Bus
+{
+public:
+    DS2482Bus(DS2482 &ds);
+
+    struct client_stats_t {
+        QString name;
+        int weight;
+        uint64_t transactions;
+        // owning the bus
+        uint64_t holdUs;
+        // queued behind other clients
+        uint64_t waitUs;
+        // held back by the rate limit
+        uint64_t throttledUs;
+        DS2482::usage_t usage;
+    };
+
+    /*!
+     * \class DS2482Bus::Transaction
+     *
+     * \brief Scoped bus ownership, blocks in the constructor until it is our
+     * turn and hands the bus to the next waiter when destroyed
+     */
+    class Transaction
+    {
+    public:
+        Transaction(DS2482Bus &bus, int client = DS2482BUS_DEFAULT_CLIENT);
+        ~Transaction();
+
+        DS2482 &ds() { return bus.ds; }
+        DS2482 *operator->() { return &bus.ds; }
+
+    private:
+        Transaction(const Transaction &) = delete;
+        Transaction &operator=(const Transaction &) = delete;
+
+        DS2482Bus &bus;
+    };
+
+    /*!
+     * \brief transact - runs fn as one atomic bus transaction
+     * \param client - client the transaction is charged to
+     * \return return value of fn
+     */
+    int transact(std::function<int(DS2482 &)> fn, int client = DS2482BUS_DEFAULT_CLIENT);
+
+    /*!
+     * \brief addClient - registers a client for accounting and scheduling
+     * \param name - name in the report
+     * \param weight - share of the bus relative to the other clients
+     * \return client id, -1 on failure
+     */
+    int addClient(const QString &name, int weight = 1);
+    int setWeight(int client, int weight);
+    /*!
+     * \brief setRateLimit - limits the bus time of a client
+     * \param usPerSecond - owned bus time per second, 0 removes the limit
+     * \param burstUs - owned bus time that may be used at once
+     * \return 0 on success, -1 on failure
+     */
+    int setRateLimit(int client, int usPerSecond, int burstUs);
+
+    int clients() const;
+    client_stats_t stats(int client) const;
+    void resetStats();
+    void printReport(FILE *f) const;
+
+private:
+    struct waiter_s;
+
+    struct client_s {
+        client_stats_t stats;
+        // owned time divided by weight
+        double virtualUs;
+        // token bucket, rate 0 is unlimited
+        int rate;
+        int burst;
+        double tokens;
+        int64_t refilledUs;
+    };
+
+    void acquire(int client);
+    void release();
+    void grant(int client, int64_t now);
+    void refill(client_s &c, int64_t now);
+
+    DS2482 &ds;
+
+    mutable std::mutex mutex;
+    bool busy = false;
+    waiter_s *head = nullptr;
+    waiter_s *tail = nullptr;
+
+    QVector<client_s> clientList;
+    // virtual time of the last granted client, idle clients catch up to it
+    double virtualUs = 0;
+    int owner = DS2482BUS_DEFAULT_CLIENT;
+    int64_t grantedUs = 0;
+    DS2482::usage_t grantedUsage = {};
+};
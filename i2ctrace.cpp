@@ -0,0 +1,259 @@
+#include "i2ctrace.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "w1clock.h"
+
+//------------------------------------------------------------------------------
+// Recorder
+//------------------------------------------------------------------------------
+I2CTraceRecorder::I2CTraceRecorder()
+{
+
+}
+
+I2CTraceRecorder::~I2CTraceRecorder()
+{
+    close();
+}
+
+int I2CTraceRecorder::open(QString fileName)
+{
+    fd = ::open(fileName.toLocal8Bit().constData(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Could not create trace file: %m\n");
+        return -1;
+    }
+
+    memcpy(buffer, I2CTRACE_MAGIC, 8);
+    used = 8;
+    records = 0;
+    lastUs = w1_now_us();
+
+    return 0;
+}
+
+void I2CTraceRecorder::close()
+{
+    if (fd != -1)
+    {
+        flush();
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+int I2CTraceRecorder::flush()
+{
+    int off = 0;
+    while (off < used)
+    {
+        ssize_t ret = ::write(fd, buffer + off, used - off);
+        if (ret < 0)
+        {
+            fprintf(stderr, "Could not write trace file: %m\n");
+            used = 0;
+            return -1;
+        }
+        off += ret;
+    }
+    used = 0;
+
+    return 0;
+}
+
+void I2CTraceRecorder::record(i2ctrace_op_t op, uint8_t cmd, uint8_t value, int result)
+{
+    if (fd == -1)
+    {
+        return;
+    }
+
+    // tag + 2 data bytes + result + up to 10 varint bytes
+    if (used + 14 > I2CTRACE_BUFFER_SIZE)
+    {
+        flush();
+    }
+
+    uint8_t *p = buffer + used;
+    *p++ = op | (result < 0 ? I2CTRACE_FAILED_BIT : 0);
+    switch (op)
+    {
+    case I2CTRACE_OP_WRITE_BYTE:
+        *p++ = value;
+        break;
+    case I2CTRACE_OP_WRITE_BYTE_DATA:
+        *p++ = cmd;
+        *p++ = value;
+        break;
+    case I2CTRACE_OP_READ_BYTE:
+        if (result >= 0)
+        {
+            *p++ = result;
+        }
+        break;
+    }
+
+    int64_t now = w1_now_us();
+    uint64_t delta = now - lastUs;
+    lastUs = now;
+    do {
+        uint8_t b = delta & 0x7F;
+        delta >>= 7;
+        *p++ = delta ? (b | 0x80) : b;
+    } while (delta);
+
+    used = p - buffer;
+    records++;
+}
+
+//------------------------------------------------------------------------------
+// Replay
+//------------------------------------------------------------------------------
+I2CTraceReplay::I2CTraceReplay()
+{
+
+}
+
+int I2CTraceReplay::open(QString fileName)
+{
+    FILE *f = fopen(fileName.toLocal8Bit().constData(), "rb");
+    if (f == NULL)
+    {
+        fprintf(stderr, "Could not open trace file: %m\n");
+        return -1;
+    }
+
+    data.clear();
+    char buf[4096];
+    size_t len;
+    while ((len = fread(buf, 1, sizeof(buf), f)) > 0)
+    {
+        data.append(buf, len);
+    }
+    fclose(f);
+
+    if (data.size() < 8 || memcmp(data.constData(), I2CTRACE_MAGIC, 8) != 0)
+    {
+        fprintf(stderr, "%s is not an i2c trace\n", fileName.toLocal8Bit().constData());
+        data.clear();
+        return -1;
+    }
+
+    rewind();
+
+    return 0;
+}
+
+void I2CTraceReplay::rewind()
+{
+    pos = 8;
+    divergedAt = -1;
+    replayed = 0;
+}
+
+void I2CTraceReplay::setRealtime(bool _realtime)
+{
+    realtime = _realtime;
+}
+
+int I2CTraceReplay::next(i2ctrace_op_t op, uint8_t cmd, uint8_t value)
+{
+    if (divergedAt >= 0)
+    {
+        return -1;
+    }
+
+    const uint8_t *p = (const uint8_t *) data.constData();
+    int size = data.size();
+    int start = pos;
+    if (pos >= size)
+    {
+        fprintf(stderr, "Trace exhausted after %llu operations\n", (unsigned long long) replayed);
+        divergedAt = pos;
+        return -1;
+    }
+
+    uint8_t tag = p[pos++];
+    bool failed = tag & I2CTRACE_FAILED_BIT;
+    bool match = (tag & I2CTRACE_OP_MASK) == op;
+    int result = failed ? -1 : 0;
+
+    switch (tag & I2CTRACE_OP_MASK)
+    {
+    case I2CTRACE_OP_WRITE_BYTE:
+        match = match && pos < size && p[pos] == value;
+        pos += 1;
+        break;
+    case I2CTRACE_OP_WRITE_BYTE_DATA:
+        match = match && pos + 1 < size && p[pos] == cmd && p[pos + 1] == value;
+        pos += 2;
+        break;
+    case I2CTRACE_OP_READ_BYTE:
+        if (!failed)
+        {
+            result = pos < size ? p[pos] : -1;
+            pos += 1;
+        }
+        break;
+    default:
+        match = false;
+        break;
+    }
+
+    uint64_t delta = 0;
+    int shift = 0;
+    while (pos < size)
+    {
+        uint8_t b = p[pos++];
+        delta |= (uint64_t) (b & 0x7F) << shift;
+        shift += 7;
+        if (!(b & 0x80))
+        {
+            break;
+        }
+    }
+
+    if (!match || pos > size)
+    {
+        fprintf(stderr, "Replay diverged at operation %llu (offset %d)\n",
+                (unsigned long long) replayed, start);
+        divergedAt = start;
+        return -1;
+    }
+
+    if (realtime && delta > 0)
+    {
+        struct timespec ts;
+        ts.tv_sec = delta / 1000000;
+        ts.tv_nsec = (delta % 1000000) * 1000;
+        nanosleep(&ts, NULL);
+    }
+
+    replayed++;
+
+    return result;
+}
+
+int I2CTraceReplay::write_byte(uint8_t value)
+{
+    return next(I2CTRACE_OP_WRITE_BYTE, 0, value);
+}
+
+int I2CTraceReplay::write_byte_data(uint8_t cmd, uint8_t value)
+{
+    return next(I2CTRACE_OP_WRITE_BYTE_DATA, cmd, value);
+}
+
+int I2CTraceReplay::read_byte()
+{
+    return next(I2CTRACE_OP_READ_BYTE, 0, 0);
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+
+#include <stdint.h>
+
+#define I2CTRACE_MAGIC       "I2CTRC01"
+#define I2CTRACE_BUFFER_SIZE 65536
+
+/*!
+ * \class I2CTransport
+ *
+ * \brief SMBus operations used by DS2482, implemented by alternative
+ * backends such as the trace replay. Return values follow i2c_smbus_*().
+ */
+class I2CTransport
+{
+public:
+    virtual ~I2CTransport() {}
+
+    virtual int write_byte(uint8_t value) = 0;
+    virtual int write_byte_data(uint8_t cmd, uint8_t value) = 0;
+    virtual int read_byte() = 0;
+};
+
+/*!
+ * \brief trace record operations
+ *
+ * A record starts with a tag byte: operation in bits 0-1, bit 2 set when the
+ * operation failed. It is followed by the written bytes (value, or cmd and
+ * value), the byte read by a successful read, and the time since the
+ * previous record in microseconds as LEB128 varint.
+ */
+enum i2ctrace_op_t {
+    I2CTRACE_OP_WRITE_BYTE      = 1,
+    I2CTRACE_OP_WRITE_BYTE_DATA = 2,
+    I2CTRACE_OP_READ_BYTE       = 3
+};
+
+#define I2CTRACE_OP_MASK    0x03
+#define I2CTRACE_FAILED_BIT (1 << 2)
+
+/*!
+ * \class I2CTraceRecorder
+ *
+ * \brief Appends every I2C operation issued by a DS2482 to a trace file
+ */
+class I2CTraceRecorder
+{
+public:
+    I2CTraceRecorder();
+    ~I2CTraceRecorder();
+
+    /*!
+     * \brief open - creates the trace file and writes the header
+     * \return 0 on success, -1 on failure
+     */
+    int open(QString fileName);
+    /*!
+     * \brief close - flushes and closes the trace file
+     */
+    void close();
+    int flush();
+
+    void record(i2ctrace_op_t op, uint8_t cmd, uint8_t value, int result);
+
+    uint64_t recordCount() const { return records; }
+
+private:
+    int fd = -1;
+    uint8_t buffer[I2CTRACE_BUFFER_SIZE];
+    int used = 0;
+    int64_t lastUs = 0;
+    uint64_t records = 0;
+};
+
+/*!
+ * \class I2CTraceReplay
+ *
+ * \brief Transport feeding the results of a recorded trace back to DS2482
+ *
+ * Every operation is checked against the trace; when the code under test
+ * issues a different operation than the one recorded, the replay diverged
+ * and all further operations fail.
+ */
+class I2CTraceReplay : public I2CTransport
+{
+public:
+    I2CTraceReplay();
+
+    /*!
+     * \brief open - loads the whole trace into memory
+     * \return 0 on success, -1 on failure
+     */
+    int open(QString fileName);
+    /*!
+     * \brief rewind - restarts the replay at the first record
+     */
+    void rewind();
+    /*!
+     * \brief setRealtime - sleep for the recorded delays between operations
+     */
+    void setRealtime(bool realtime);
+
+    int write_byte(uint8_t value) override;
+    int write_byte_data(uint8_t cmd, uint8_t value) override;
+    int read_byte() override;
+
+    bool atEnd() const { return pos >= data.size(); }
+    bool diverged() const { return divergedAt >= 0; }
+    uint64_t replayedCount() const { return replayed; }
+
+private:
+    int next(i2ctrace_op_t op, uint8_t cmd, uint8_t value);
+
+    QByteArray data;
+    int pos = 0;
+    int divergedAt = -1;
+    uint64_t replayed = 0;
+    bool realtime = false;
+};
@@ -1,7 +1,12 @@
 #include <QCoreApplication>
+#include <QCommandLineParser>
 #include <QDebug>
+#include <QSet>
+#include <QVector>
 
 #include <stdio.h>
+#include <string.h>
+#include <signal.h>
 #include <time.h>
 
 #include <inttypes.h>
@@ -12,45 +17,846 @@
 #include <fcntl.h>
 #include <unistd.h>
 
+#include <atomic>
+#include <thread>
+
 #define ADDRESS 0x18
+#define MAX_DEVICES 1024
+// --sample-pio gives up after this many bus or CRC errors in a row, the
+// retries back off up to SAMPLE_MAX_BACKOFF_US
+#define SAMPLE_MAX_ERRORS 20
+#define SAMPLE_MAX_BACKOFF_US 100000
 
 #include "ds2482.h"
+#include "ds2431provisioner.h"
+#include "ds2480b.h"
+#include "ds2480bsim.h"
+#include "ds2482async.h"
+#include "i2ctrace.h"
+#include "w1cache.h"
+#include "w1churn.h"
+#include "w1daemon.h"
+#include "w1executor.h"
+#include "w1inventory.h"
+#include "w1linktuner.h"
+#include "w1piosampler.h"
+#include "w1romregistry.h"
+#include "w1rtthread.h"
+#include "w1clock.h"
+#include "w1sequence.h"
+#include "w1simbus.h"
+#include "w1telemetry.h"
+#include "w1touchport.h"
+
+// lock-free, so it may be set from the signal handler
+static std::atomic<bool> stopRequested(false);
+
+static void stopHandler(int)
+{
+    stopRequested = true;
+}
+
+static void installStopHandler()
+{
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stopHandler;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+}
+
+int highspeedScan(W1Bridge &ds, W1LinkTuner &tuner, uint64_t *devices, int maxDevices)
+{
+    int count = -1;
+    if (tuner.prepareSearch(ds) == 0)
+    {
+        count = ds.findDevices(devices, maxDevices);
+    }
+    tuner.report(0, count >= 0);
+
+    return count;
+}
+
+int provision(DS2482 &ds, QString imageFile, bool controlPage)
+{
+    uint8_t image[DS2431_MEMORY_SIZE];
+    FILE *f = fopen(imageFile.toLocal8Bit().constData(), "rb");
+    if (f == NULL)
+    {
+        fprintf(stderr, "Could not open image: %m\n");
+        return -1;
+    }
+    int len = fread(image, 1, sizeof(image), f);
+    fclose(f);
+
+    QList<uint64_t> devices;
+    foreach (uint64_t dev, ds.findDevices())
+    {
+        if ((dev & 0xFF) == DS2431_FAMILY_CODE)
+        {
+            devices << dev;
+        }
+    }
+
+    DS2431Provisioner provisioner;
+    provisioner.addLane(&ds, -1, devices);
+    provisioner.setControlPage(controlPage);
+    int failed = provisioner.run(0, image, len - len % DS2431_ROW_SIZE);
+    if (failed < 0)
+    {
+        return -1;
+    }
+
+    foreach (const DS2431Provisioner::device_result_t &dev, provisioner.results())
+    {
+        printf("%016llx %s (row %d)\n", (unsigned long long) dev.rom,
+               dev.status == DS2431Provisioner::DEVICE_OK ? "ok" : "FAILED", dev.row);
+    }
+    printf("%d devices in %lld ms, %d failed\n", devices.count(),
+           (long long) provisioner.elapsedUs() / 1000, failed);
+
+    return failed == 0 ? 0 : -1;
+}
+
+int samplePio(W1Bridge &ds, QString romHex, int seconds, bool overdrive)
+{
+    bool ok;
+    uint64_t rom = romHex.toULongLong(&ok, 16);
+    if (!ok)
+    {
+        fprintf(stderr, "Invalid rom: %s\n", romHex.toLocal8Bit().constData());
+        return -1;
+    }
+
+    W1PioSampler sampler;
+    sampler.setOverdrive(overdrive);
+    if (sampler.start(ds, rom) != W1PIO_OK)
+    {
+        return -1;
+    }
 
-QSet<uint64_t> highspeedScan(DS2482 &ds)
+    // print state changes only
+    int last = -1;
+    int errors = 0;
+    int ret = 0;
+    int64_t start = w1_now_us();
+    int64_t end = start + (int64_t) seconds * 1000000;
+    while (w1_now_us() < end)
+    {
+        int polled = sampler.poll(ds);
+        if (polled == W1PIO_BUS_ERROR || polled == W1PIO_CRC_ERROR)
+        {
+            // an absent device fails at once, a shorted or noisy bus keeps
+            // failing its CRC, do not spin on either
+            if (++errors >= SAMPLE_MAX_ERRORS)
+            {
+                fprintf(stderr, "Giving up on %016llx after %d errors\n",
+                        (unsigned long long) rom, errors);
+                ret = -1;
+                break;
+            }
+            fprintf(stderr, polled == W1PIO_CRC_ERROR ? "CRC error reading %016llx\n"
+                                                      : "Could not read %016llx\n",
+                    (unsigned long long) rom);
+            int64_t backoffUs = (int64_t) 1000 << errors;
+            usleep(backoffUs < SAMPLE_MAX_BACKOFF_US ? backoffUs : SAMPLE_MAX_BACKOFF_US);
+            continue;
+        }
+        errors = 0;
+
+        W1PioSampler::sample_t samples[W1PIO_DS2408_PACKET];
+        int n;
+        while ((n = sampler.read(samples, W1PIO_DS2408_PACKET)) > 0)
+        {
+            for (int i = 0; i < n; i++)
+            {
+                if (samples[i].state != last)
+                {
+                    printf("%lld.%06lld %02x\n", (long long) (samples[i].timeUs - start) / 1000000,
+                           (long long) (samples[i].timeUs - start) % 1000000, samples[i].state);
+                    last = samples[i].state;
+                }
+            }
+        }
+    }
+    sampler.stop(ds);
+
+    W1PioSampler::stats_t stats = sampler.stats();
+    printf("%llu samples (%.0f/s), %llu packets, %u crc errors, %u starts\n",
+           (unsigned long long) stats.samples, stats.samples / (double) seconds,
+           (unsigned long long) stats.packets, stats.crcErrors, stats.starts);
+
+    return ret;
+}
+
+int touchPort(W1Bridge &ds, int intervalUs, int priority, int cpu)
 {
-    ds.set_high_speed(false);
-    ds.w1_reset();
+    W1TouchPort port;
+    W1RealtimeThread thread;
+    thread.setPriority(priority);
+    thread.setCpu(cpu);
+    thread.setLockMemory(priority > 0);
+
+    ds.setLogging(false);
+    if (thread.startPeriodic(intervalUs, [&ds, &port] { return port.poll(ds); }) != 0)
+    {
+        return -1;
+    }
 
-    //        nanosleep(&sl, NULL);
-    //        qDebug() << "send overdrive";
-    if (ds.w1_write_byte(DS2482::W1_CMD_OVERDRIVE_SKIP_ROM) != 0)
+    while (!stopRequested)
     {
-        fprintf(stderr, "Could not skip overdrive\n");
-        return QSet<uint64_t>();
+        W1TouchPort::event_t event;
+        while (port.takeEvent(&event))
+        {
+            if (event.type == W1TouchPort::EVENT_INSERTED)
+            {
+                printf("inserted %016llx in %lld us\n", (unsigned long long) event.rom,
+                       (long long) event.latencyUs);
+            } else {
+                printf("removed  %016llx\n", (unsigned long long) event.rom);
+            }
+            fflush(stdout);
+        }
+        usleep(10000);
     }
 
-    ds.set_high_speed(true);
-    ds.w1_reset();
+    thread.stop();
+    ds.setLogging(true);
 
-    QSet<uint64_t> devices = ds.findDevices().toSet();
+    W1TouchPort::stats_t stats = port.stats();
+    printf("%llu polls, %u inserted, %u removed, %u crc errors, %u bus errors, "
+           "latency avg %lld us max %lld us\n",
+           (unsigned long long) stats.polls, stats.inserted, stats.removed, stats.crcErrors,
+           stats.busErrors,
+           (long long) (stats.inserted > 0 ? stats.totalLatencyUs / stats.inserted : 0),
+           (long long) stats.maxLatencyUs);
+    thread.printJitterReport(stdout);
 
-    return devices;
+    return 0;
+}
+
+int dumpTelemetry(QString fileName)
+{
+    static const char *typeNames[] = {
+        "end", "rom", "time", "reading", "found", "removed", "error"
+    };
+
+    W1TelemetryReader reader;
+    if (reader.open(fileName) != 0)
+    {
+        return -1;
+    }
+
+    w1telemetry_entry_t entry;
+    while (reader.next(&entry))
+    {
+        printf("%lld.%06lld %016llx %-8s ", (long long) entry.timeUs / 1000000,
+               (long long) entry.timeUs % 1000000, (unsigned long long) entry.rom,
+               entry.type <= W1TLM_ERROR ? typeNames[entry.type] : "?");
+        for (int i = 0; i < entry.len; i++)
+        {
+            printf("%02x", entry.data[i]);
+        }
+        printf("\n");
+    }
+
+    return 0;
+}
+
+int benchRegistry(int count)
+{
+    const int passes = 200;
+    const int churn = count / 100 + 1;
+
+    // a few families, ids only need to be unique
+    QVector<uint64_t> roms(count);
+    uint64_t next = 1;
+    for (int i = 0; i < count; i++)
+    {
+        roms[i] = ((next++ * 0x9E3779B97F4A7C15ULL) << 8) | (i % 4 == 0 ? 0x28 : DS2431_FAMILY_CODE);
+    }
+
+    // every pass replaces some devices, both sides see the same scan results
+    QVector<QVector<uint64_t> > scans;
+    for (int p = 0; p < passes; p++)
+    {
+        for (int i = 0; i < churn; i++)
+        {
+            roms[(p * churn + i) % count] = ((next++ * 0x9E3779B97F4A7C15ULL) << 8) | 0x3A;
+        }
+        scans.append(roms);
+    }
+
+    uint64_t setAdded = 0, setRemoved = 0;
+    int64_t start = w1_now_us();
+    QSet<uint64_t> prevDevices;
+    for (int p = 0; p < passes; p++)
+    {
+        QSet<uint64_t> devices;
+        for (int i = 0; i < count; i++)
+        {
+            devices.insert(scans[p][i]);
+        }
+        setAdded += (devices - prevDevices).count();
+        setRemoved += (prevDevices - devices).count();
+        prevDevices = devices;
+    }
+    int64_t setUs = w1_now_us() - start;
+
+    W1RomRegistry registry;
+    QVector<uint64_t> added(count), removed(count);
+    uint64_t registryAdded = 0, registryRemoved = 0;
+    start = w1_now_us();
+    for (int p = 0; p < passes; p++)
+    {
+        int addedCount, removedCount;
+        registry.reconcile(0, scans[p].constData(), count, added.data(), &addedCount,
+                           removed.data(), &removedCount);
+        registryAdded += addedCount;
+        registryRemoved += removedCount;
+    }
+    int64_t registryUs = w1_now_us() - start;
+
+    printf("%d devices, %d passes, %d replaced per pass\n", count, passes, churn);
+    printf("%-10s %10s %10s %12s\n", "", "added", "removed", "us/pass");
+    printf("%-10s %10llu %10llu %12.1f\n", "QSet", (unsigned long long) setAdded,
+           (unsigned long long) setRemoved, (double) setUs / passes);
+    printf("%-10s %10llu %10llu %12.1f\n", "registry", (unsigned long long) registryAdded,
+           (unsigned long long) registryRemoved, (double) registryUs / passes);
+
+    if (setAdded != registryAdded || setRemoved != registryRemoved)
+    {
+        fprintf(stderr, "Registry and QSet diff disagree\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+int scanBridge(W1Bridge &ds)
+{
+    static uint64_t devices[MAX_DEVICES];
+
+    int64_t start = w1_now_us();
+    int count = ds.findDevices(devices, MAX_DEVICES);
+    if (count < 0)
+    {
+        fprintf(stderr, "Could not scan bus\n");
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        printf("%016llx\n", (unsigned long long) devices[i]);
+    }
+    printf("%d devices in %lld ms\n", count, (long long) (w1_now_us() - start) / 1000);
+
+    return 0;
+}
+
+int simulateDS2480B(int count)
+{
+    W1SimBus bus;
+    QSet<uint64_t> expected;
+    for (int i = 0; i < count; i++)
+    {
+        uint64_t rom = W1SimBus::makeRom(DS2431_FAMILY_CODE, 0x1000 + i * 0x10001ULL);
+        bus.addDevice(rom);
+        expected.insert(rom);
+    }
+
+    DS2480BSimulator sim(bus);
+    DS2480B ds;
+    if (sim.start() != 0 || ds.open(sim.devicePath()) != 0)
+    {
+        return -1;
+    }
+
+    QSet<uint64_t> found = ds.findDevices().toSet();
+
+    // read the memory of one device back through data mode
+    int memoryOk = 1;
+    if (count > 0)
+    {
+        uint8_t pattern[DS2431_MEMORY_SIZE];
+        uint8_t buf[DS2431_MEMORY_SIZE];
+        for (int i = 0; i < DS2431_MEMORY_SIZE; i++)
+        {
+            pattern[i] = i * 7;
+        }
+        uint64_t rom = *expected.begin();
+        bus.setMemory(rom, 0, pattern, sizeof(pattern));
+        memoryOk = ds.ds2431_read_memory(rom, 0, buf, sizeof(buf)) == (int) sizeof(buf)
+                && memcmp(buf, pattern, sizeof(buf)) == 0;
+    }
+
+    printf("%d of %d devices found, memory read %s, %llu serial bytes, %llu us bus time\n",
+           (int) (found & expected).count(), count, memoryOk ? "ok" : "FAILED",
+           (unsigned long long) sim.bytesReceived(), (unsigned long long) bus.timeUs());
+
+    ds.close();
+    sim.stop();
+
+    return found == expected && memoryOk ? 0 : -1;
+}
+
+int churn(QString deviceCounts, QString touchRates, int duration, int overhead)
+{
+    W1ChurnBenchmark bench;
+    bench.setDuration(duration);
+    bench.setBridgeOverhead(overhead);
+
+    W1ChurnBenchmark::printHeader(stdout);
+    foreach (const QString &devices, deviceCounts.split(','))
+    {
+        foreach (const QString &rate, touchRates.split(','))
+        {
+            W1ChurnBenchmark::result_t result;
+            bench.setDevices(devices.toInt());
+            bench.setTouchRate(rate.toDouble());
+            if (bench.run(&result) != 0)
+            {
+                return -1;
+            }
+            W1ChurnBenchmark::printResult(stdout, result);
+            fflush(stdout);
+        }
+    }
+
+    return 0;
+}
+
+W1Task<void> asyncReadBridge(DS2482Async &bus, QList<uint64_t> devices)
+{
+    foreach (uint64_t rom, devices)
+    {
+        if ((rom & 0xFF) != DS2431_FAMILY_CODE)
+        {
+            continue;
+        }
+
+        uint8_t buf[DS2431_MEMORY_SIZE];
+        W1AsyncLock::Guard guard = co_await bus.acquire();
+        int ret = co_await bus.ds2431_read_memory(rom, 0, buf, sizeof(buf));
+        guard.release();
+
+        if (ret != (int) sizeof(buf))
+        {
+            fprintf(stderr, "%016" PRIx64 ": read failed\n", rom);
+            continue;
+        }
+        printf("%016" PRIx64 ":", rom);
+        for (int i = 0; i < 16; i++)
+        {
+            printf(" %02x", buf[i]);
+        }
+        printf(" ...\n");
+    }
+}
+
+int asyncRead(QString addresses)
+{
+    W1Executor executor;
+    QList<DS2482 *> bridges;
+    QList<DS2482Async *> buses;
+    int ret = 0;
+
+    // one coroutine per bridge, they overlap while the bridges are busy
+    foreach (const QString &address, addresses.split(','))
+    {
+        DS2482 *ds = new DS2482();
+        bridges.append(ds);
+        if (ds->open("/dev/i2c-2", address.toInt(nullptr, 0)) != 0)
+        {
+            fprintf(stderr, "Could not open bridge %s\n", qPrintable(address));
+            ret = -1;
+            break;
+        }
+        ds->set_active_pullup(true);
+
+        DS2482Async *bus = new DS2482Async(*ds, executor);
+        buses.append(bus);
+        executor.spawn(asyncReadBridge(*bus, ds->findDevices()));
+    }
+
+    if (ret == 0)
+    {
+        ret = executor.run(&stopRequested);
+        executor.printReport(stdout);
+    }
+
+    qDeleteAll(buses);
+    foreach (DS2482 *ds, bridges)
+    {
+        ds->close();
+    }
+    qDeleteAll(bridges);
+
+    return ret;
+}
+
+int cacheRead(DS2482 &ds, int threads, int seconds, int ttlMs, int scanWeight, int scanRate)
+{
+    QList<uint64_t> devices;
+    foreach (uint64_t rom, ds.findDevices())
+    {
+        if ((rom & 0xFF) == DS2431_FAMILY_CODE)
+        {
+            devices << rom;
+        }
+    }
+    if (devices.isEmpty())
+    {
+        fprintf(stderr, "No DS2431 found\n");
+        return -1;
+    }
+
+    DS2482Bus bus(ds);
+    W1Cache cache(bus);
+    cache.setTtl(W1Cache::OP_DS2431_MEMORY, ttlMs);
+    cache.setClient(bus.addClient("cache"));
+
+    std::atomic<uint64_t> requests(0);
+    std::atomic<uint64_t> scans(0);
+    int64_t end = w1_now_us() + (int64_t) seconds * 1000000;
+    QList<std::thread *> workers;
+
+    // searches compete with the readers for their share of the bus
+    if (scanWeight > 0)
+    {
+        int scanClient = bus.addClient("scan", scanWeight);
+        if (scanClient < 0 || (scanRate > 0 && bus.setRateLimit(scanClient, scanRate, scanRate) != 0))
+        {
+            return -1;
+        }
+        workers << new std::thread([&, scanClient] {
+            while (w1_now_us() < end && !stopRequested)
+            {
+                bus.transact([](DS2482 &ds) {
+                    uint64_t found[MAX_DEVICES];
+                    return ds.findDevices(found, MAX_DEVICES);
+                }, scanClient);
+                scans++;
+            }
+        });
+    }
+
+    // every thread reads all devices, so most requests are hits or coalesced
+    for (int i = 0; i < threads; i++)
+    {
+        workers << new std::thread([&] {
+            while (w1_now_us() < end && !stopRequested)
+            {
+                foreach (uint64_t rom, devices)
+                {
+                    uint8_t buf[DS2431_MEMORY_SIZE];
+                    cache.readMemory(rom, 0, buf, sizeof(buf));
+                    requests++;
+                }
+            }
+        });
+    }
+    foreach (std::thread *worker, workers)
+    {
+        worker->join();
+    }
+    qDeleteAll(workers);
+
+    W1Cache::stats_t stats = cache.stats();
+    printf("%llu requests (%.0f/s), %llu hits, %llu misses, %llu coalesced, %llu errors\n",
+           (unsigned long long) requests.load(), requests.load() / (double) seconds,
+           (unsigned long long) stats.hits, (unsigned long long) stats.misses,
+           (unsigned long long) stats.coalesced, (unsigned long long) stats.errors);
+    if (scanWeight > 0)
+    {
+        printf("%llu scans\n", (unsigned long long) scans.load());
+    }
+    bus.printReport(stdout);
+
+    return 0;
 }
 
 int main(int argc, char *argv[])
 {
     QCoreApplication a(argc, argv);
 
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption daemonOption("daemon", "Run as bus daemon.");
+    parser.addOption(daemonOption);
+    QCommandLineOption shmOption("shm", "Shared memory segment of the daemon.", "name",
+                                 W1SHM_DEFAULT_NAME);
+    parser.addOption(shmOption);
+    QCommandLineOption socketOption("socket", "Command socket of the daemon.", "path",
+                                    W1DAEMON_DEFAULT_SOCKET);
+    parser.addOption(socketOption);
+    QCommandLineOption provisionOption("provision",
+                                       "Program an image into all DS2431 on the bus.", "file");
+    parser.addOption(provisionOption);
+    QCommandLineOption provisionControlOption("provision-control-page",
+                                              "Allow the image to write the protection and control page.");
+    parser.addOption(provisionControlOption);
+    QCommandLineOption rtPriorityOption("rt-priority",
+                                        "SCHED_FIFO priority of the bus thread.", "priority", "0");
+    parser.addOption(rtPriorityOption);
+    QCommandLineOption rtCpuOption("rt-cpu", "CPU the bus thread is pinned to.", "cpu", "-1");
+    parser.addOption(rtCpuOption);
+    QCommandLineOption samplePioOption("sample-pio",
+                                       "Stream the inputs of a DS2408 or DS2413 and exit.", "rom");
+    parser.addOption(samplePioOption);
+    QCommandLineOption sampleSecondsOption("sample-seconds", "Duration of --sample-pio.",
+                                           "seconds", "5");
+    parser.addOption(sampleSecondsOption);
+    QCommandLineOption sampleOverdriveOption("sample-overdrive",
+                                             "Stream --sample-pio at overdrive speed.");
+    parser.addOption(sampleOverdriveOption);
+    QCommandLineOption touchPortOption("touch-port",
+                                       "Watch a single-drop port with presence polling and READ ROM.");
+    parser.addOption(touchPortOption);
+    QCommandLineOption touchIntervalOption("touch-interval", "Presence poll period of --touch-port.",
+                                           "us", QString::number(W1TOUCH_DEFAULT_POLL_US));
+    parser.addOption(touchIntervalOption);
+    QCommandLineOption jitterOption("jitter",
+                                    "Measure presence poll jitter for some seconds.", "seconds");
+    parser.addOption(jitterOption);
+    QCommandLineOption telemetryOption("telemetry", "Binary telemetry log of the daemon.",
+                                       "file");
+    parser.addOption(telemetryOption);
+    QCommandLineOption dumpTelemetryOption("dump-telemetry", "Print a telemetry log and exit.",
+                                           "file");
+    parser.addOption(dumpTelemetryOption);
+    QCommandLineOption inventoryOption("inventory", "Device inventory used for warm starts.",
+                                       "file");
+    parser.addOption(inventoryOption);
+    QCommandLineOption recordOption("record", "Record all i2c traffic to a trace file.", "file");
+    parser.addOption(recordOption);
+    QCommandLineOption replayOption("replay", "Replay a recorded trace instead of using the bus.",
+                                    "file");
+    parser.addOption(replayOption);
+    QCommandLineOption benchRegistryOption("bench-registry",
+                                           "Compare registry and QSet diffing and exit.", "devices");
+    parser.addOption(benchRegistryOption);
+    QCommandLineOption ds2480bOption("ds2480b", "Scan the bus of a DS2480B serial bridge and exit.",
+                                     "tty");
+    parser.addOption(ds2480bOption);
+    QCommandLineOption simulateDS2480BOption("simulate-ds2480b",
+                                             "Scan simulated devices through a DS2480B on a pseudo terminal.",
+                                             "devices");
+    parser.addOption(simulateDS2480BOption);
+    QCommandLineOption churnOption("churn",
+                                   "Measure hot-plug detection on a simulated bus with the given "
+                                   "static device counts (comma separated) and exit.", "devices");
+    parser.addOption(churnOption);
+    QCommandLineOption churnRateOption("churn-rate", "iButton touches per minute (comma separated).",
+                                       "rates", "200");
+    parser.addOption(churnRateOption);
+    QCommandLineOption churnDurationOption("churn-duration", "Simulated seconds per scenario.",
+                                           "seconds", "60");
+    parser.addOption(churnDurationOption);
+    QCommandLineOption churnOverheadOption("churn-overhead",
+                                           "Bridge round trip per primitive in microseconds.",
+                                           "us", "0");
+    parser.addOption(churnOverheadOption);
+    QCommandLineOption asyncReadOption("async-read",
+                                       "Read all DS2431 behind the given bridge addresses (comma "
+                                       "separated) concurrently and exit.", "addresses");
+    parser.addOption(asyncReadOption);
+    QCommandLineOption cacheReadOption("cache-read",
+                                       "Read all DS2431 from several threads through the read cache "
+                                       "and exit.", "threads");
+    parser.addOption(cacheReadOption);
+    QCommandLineOption cacheSecondsOption("cache-seconds", "Duration of --cache-read.", "seconds",
+                                          "5");
+    parser.addOption(cacheSecondsOption);
+    QCommandLineOption cacheTtlOption("cache-ttl", "Lifetime of cached --cache-read results.",
+                                      "ms", QString::number(W1CACHE_DEFAULT_TTL_MS));
+    parser.addOption(cacheTtlOption);
+    QCommandLineOption cacheScanOption("cache-scan",
+                                       "Scan the bus next to --cache-read, with this share weight "
+                                       "against the readers.", "weight", "0");
+    parser.addOption(cacheScanOption);
+    QCommandLineOption cacheScanRateOption("cache-scan-rate",
+                                           "Bus time the scans of --cache-scan may use.", "us/s",
+                                           "0");
+    parser.addOption(cacheScanRateOption);
+    parser.process(a);
+
+    if (parser.isSet(dumpTelemetryOption))
+    {
+        return dumpTelemetry(parser.value(dumpTelemetryOption)) == 0 ? 0 : 1;
+    }
+
+    if (parser.isSet(benchRegistryOption))
+    {
+        return benchRegistry(parser.value(benchRegistryOption).toInt()) == 0 ? 0 : 1;
+    }
+
+    if (parser.isSet(simulateDS2480BOption))
+    {
+        return simulateDS2480B(parser.value(simulateDS2480BOption).toInt()) == 0 ? 0 : 1;
+    }
+
+    if (parser.isSet(churnOption))
+    {
+        return churn(parser.value(churnOption), parser.value(churnRateOption),
+                     parser.value(churnDurationOption).toInt(),
+                     parser.value(churnOverheadOption).toInt()) == 0 ? 0 : 1;
+    }
+
+    if (parser.isSet(asyncReadOption))
+    {
+        installStopHandler();
+        return asyncRead(parser.value(asyncReadOption)) == 0 ? 0 : 1;
+    }
+
+    if (parser.isSet(ds2480bOption))
+    {
+        DS2480B bridge;
+        if (bridge.open(parser.value(ds2480bOption)) != 0)
+        {
+            return 1;
+        }
+        int ret = scanBridge(bridge);
+        bridge.close();
+        return ret == 0 ? 0 : 1;
+    }
+
     DS2482 ds;
-    if (ds.open("/dev/i2c-2", 0x18) != 0)
+    I2CTraceRecorder recorder;
+    I2CTraceReplay replay;
+    int64_t replayStart = w1_now_us();
+
+    if (parser.isSet(recordOption))
+    {
+        if (recorder.open(parser.value(recordOption)) != 0)
+        {
+            return 1;
+        }
+        ds.setRecorder(&recorder);
+    }
+
+    if (parser.isSet(replayOption))
     {
+        if (replay.open(parser.value(replayOption)) != 0
+                || ds.open(&replay) != 0)
+        {
+            fprintf(stderr, "Could not replay trace\n");
+            return 1;
+        }
+    } else if (ds.open("/dev/i2c-2", 0x18) != 0) {
         fprintf(stderr, "Could not open i2c device\n");
         return 1;
     }
 
     ds.set_active_pullup(true);
 
-    QSet<uint64_t> prevDevices;
+    if (parser.isSet(provisionOption))
+    {
+        int ret = provision(ds, parser.value(provisionOption),
+                            parser.isSet(provisionControlOption));
+        ds.close();
+        return ret == 0 ? 0 : 1;
+    }
+
+    if (parser.isSet(samplePioOption))
+    {
+        int ret = samplePio(ds, parser.value(samplePioOption),
+                            parser.value(sampleSecondsOption).toInt(),
+                            parser.isSet(sampleOverdriveOption));
+        ds.close();
+        return ret == 0 ? 0 : 1;
+    }
+
+    if (parser.isSet(cacheReadOption))
+    {
+        installStopHandler();
+        int ret = cacheRead(ds, parser.value(cacheReadOption).toInt(),
+                            parser.value(cacheSecondsOption).toInt(),
+                            parser.value(cacheTtlOption).toInt(),
+                            parser.value(cacheScanOption).toInt(),
+                            parser.value(cacheScanRateOption).toInt());
+        ds.close();
+        return ret == 0 ? 0 : 1;
+    }
+
+    if (parser.isSet(jitterOption))
+    {
+        W1RealtimeThread thread;
+        thread.setPriority(parser.value(rtPriorityOption).toInt());
+        thread.setCpu(parser.value(rtCpuOption).toInt());
+        thread.setLockMemory(parser.value(rtPriorityOption).toInt() > 0);
+
+        ds.setLogging(false);
+        if (thread.startPeriodic(10000, [&ds] { return ds.w1_reset(); }) != 0)
+        {
+            return 1;
+        }
+
+        sleep(parser.value(jitterOption).toInt());
+        thread.stop();
+        ds.setLogging(true);
+
+        thread.printJitterReport(stdout);
+        printf("bridge errors: %u\n", ds.errors());
+        ds.close();
+        return 0;
+    }
+
+    if (parser.isSet(touchPortOption))
+    {
+        installStopHandler();
+        int ret = touchPort(ds, parser.value(touchIntervalOption).toInt(),
+                            parser.value(rtPriorityOption).toInt(),
+                            parser.value(rtCpuOption).toInt());
+        ds.close();
+        return ret == 0 ? 0 : 1;
+    }
+
+    if (parser.isSet(daemonOption))
+    {
+        installStopHandler();
+
+        W1Daemon daemon(ds);
+        daemon.setRealtime(parser.value(rtPriorityOption).toInt(),
+                           parser.value(rtCpuOption).toInt());
+        W1TelemetryWriter telemetry;
+        if (parser.isSet(telemetryOption))
+        {
+            if (telemetry.open(parser.value(telemetryOption)) != 0)
+            {
+                return 1;
+            }
+            daemon.setTelemetry(&telemetry);
+        }
+
+        W1Inventory inventory;
+        if (parser.isSet(inventoryOption))
+        {
+            if (inventory.load(parser.value(inventoryOption)) != 0)
+            {
+                return 1;
+            }
+            daemon.setInventory(&inventory, parser.value(inventoryOption),
+                                W1Inventory::busKey("/dev/i2c-2", 0x18, 0));
+        }
+        if (daemon.open(parser.value(shmOption), parser.value(socketOption)) != 0)
+        {
+            fprintf(stderr, "Could not start daemon\n");
+            return 1;
+        }
+
+        int ret = daemon.run(&stopRequested);
+        daemon.close();
+        ds.close();
+
+        return ret == 0 ? 0 : 1;
+    }
+
+    W1RomRegistry registry;
+    W1LinkTuner tuner;
+    static uint64_t devices[MAX_DEVICES];
+    static uint64_t added[MAX_DEVICES];
+    static uint64_t removed[MAX_DEVICES];
 
     for (;;)
     {
@@ -61,34 +867,43 @@ int main(int argc, char *argv[])
 
         qDebug() << "--";
 
-        QSet<uint64_t> devices = highspeedScan(ds);
+        int count = highspeedScan(ds, tuner, devices, MAX_DEVICES);
 
         for (int i = 0; i < 1; i++) {
 //            devices.unite(highspeedScan(ds));
 //            nanosleep(&sl, NULL);
         }
 
-        QSet<uint64_t> newDevices = devices - prevDevices;
-        foreach (uint64_t dev, newDevices)
+        // a failed search keeps the known devices and their link history
+        if (count >= 0)
         {
-            qDebug() << "found" << QString("%1").arg(dev, 0, 16);
+            int addedCount, removedCount;
+            registry.reconcile(0, devices, count, added, &addedCount, removed, &removedCount);
+            for (int i = 0; i < addedCount; i++)
+            {
+                qDebug() << "found" << QString("%1").arg(added[i], 0, 16);
+            }
+
+            for (int i = 0; i < removedCount; i++)
+            {
+                qDebug() << "removed" << QString("%1").arg(removed[i], 0, 16);
+                tuner.forget(removed[i]);
+            }
         }
 
-        QSet<uint64_t> removedDevices = prevDevices - devices;
-        foreach (uint64_t dev, removedDevices)
+        if (!parser.isSet(replayOption))
         {
-            qDebug() << "removed" << QString("%1").arg(dev, 0, 16);
+            nanosleep(&sl, NULL);
         }
 
-        prevDevices = devices;
-
-        nanosleep(&sl, NULL);
-
-        foreach (uint64_t dev, prevDevices)
+        for (int slot = registry.firstOnBus(0); slot != W1ROMREGISTRY_NONE;
+             slot = registry.nextOnBus(slot))
         {
-            if (ds.w1_match_rom(dev) != 0)
+            uint64_t dev = registry.rom(slot);
+            if (tuner.select(ds, dev) != 0)
             {
                 fprintf(stderr, "Could not match rom: %llx\n", dev);
+                tuner.report(dev, false);
                 continue;
             }
 
@@ -97,47 +912,49 @@ int main(int argc, char *argv[])
             ds.w1_resume();
 
             {
-                uint8_t data[11] = {
-                    DS2482::DS2431_CMD_WRITE_SCRATCHPAD,
-                    0x00, 0x00,
+                static const uint8_t row[DS2431_ROW_SIZE] = {
                     0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08
                 };
-                ds.w1_write_block(data, 3);
-                ds.w1_write_block(data + 3, 8);
-
-                uint16_t crc = DS2482::w1_compute_data_crc(data, 11);
-                printf("CRC: %x\n", crc);
+                DS2431WriteScratchpad write;
+                write.setAddress(0);
+                memcpy(write.payload(), row, sizeof(row));
+                printf("write scratchpad: %d\n", write.execute(ds));
             }
 
-//             read crc
-            uint8_t crc[4];
-            ds.w1_read_block(crc, 4);
-
-            printf("CRC: %x %x %x %x\n", crc[0], crc[1], crc[2], crc[3]);
-
             ds.w1_resume();
 
-            ds.w1_write_byte(DS2482::DS2431_CMD_READ_SCRATCHPAD);
             {
-                uint8_t data[16] = { 0 };
-                ds.w1_read_block(data + 1, 15);
-                data[0] = DS2482::DS2431_CMD_READ_SCRATCHPAD;
-                for (int i = 0; i < 16; i++)
+                DS2431ReadScratchpad read;
+                int ret = read.execute(ds);
+                tuner.report(dev, ret == W1SEQ_OK);
+                for (int i = 0; i < DS2431ReadScratchpad::frameLen; i++)
                 {
-                    printf("%d: %x\n", i, data[i]);
+                    printf("%d: %x\n", i, read.data()[i]);
                 }
-
-                uint16_t crc = DS2482::w1_compute_data_crc(data, 12);
-                printf("CRC: %x\n", crc);
+                printf("read scratchpad: %d\n", ret);
             }
         }
         }
 
-        nanosleep(&sl, NULL);
+        if (!parser.isSet(replayOption))
+        {
+            nanosleep(&sl, NULL);
+        }
         break;
     }
 
+    tuner.printReport(stderr);
+
     ds.close();
+    recorder.close();
+
+    if (parser.isSet(replayOption))
+    {
+        fprintf(stderr, "replayed %llu i2c operations in %lld us%s\n",
+                (unsigned long long) replay.replayedCount(),
+                (long long) (w1_now_us() - replayStart),
+                replay.diverged() ? " (diverged)" : "");
+    }
 
     return 0;
 }
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <QList>
+
+#include <stdint.h>
+
+#define DS2431_FAMILY_CODE 0x2D
+#define DS2431_MEMORY_SIZE 0x90
+// four data pages, followed by the protection and control bytes
+#define DS2431_DATA_SIZE   0x80
+#define DS2431_ROW_SIZE    8
+#define DS2408_FAMILY_CODE 0x29
+#define DS2413_FAMILY_CODE 0x3A
+
+/*!
+ * \class W1Bridge
+ *
+ * \brief 1-wire master independent of the bridge chip
+ *
+ * Implementations provide the bus primitives (reset, bits, bytes and the
+ * bridge configuration). The search protocol, ROM commands and CRCs are
+ * built on top of them here. Block transfers and the search triplet have
+ * byte or bit based defaults that bridges with a faster path override.
+ */
+class W1Bridge
+{
+public:
+    W1Bridge();
+    virtual ~W1Bridge();
+
+    enum w1_cmd_t {
+        W1_CMD_SEARCH_ROM =          0xF0,
+        W1_CMD_READ_ROM =            0x33,
+        W1_CMD_MATCH_ROM =           0x55,
+        W1_CMD_SKIP_ROM =            0xCC,
+        W1_CMD_RESUME =              0xA5,
+        W1_CMD_OVERDRIVE_SKIP_ROM =  0x3C,
+        W1_CMD_OVERDRIVE_MATCH_ROM = 0x69
+    };
+
+    enum ds2431_cmd_t {
+        DS2431_CMD_WRITE_SCRATCHPAD = 0x0F,
+        DS2431_CMD_READ_SCRATCHPAD  = 0xAA,
+        DS2431_CMD_COPY_SCRATCHPAD  = 0x55,
+        DS2431_CMD_READ_MEMORY      = 0xF0
+    };
+
+    enum pio_cmd_t {
+        // DS2408 channel access read, DS2413 PIO access read
+        PIO_CMD_ACCESS_READ = 0xF5
+    };
+
+    typedef uint8_t bit_t;
+
+    /*!
+     * \brief setLogging - enables or disables error messages on stderr,
+     * errors are counted in both cases
+     */
+    void setLogging(bool logging);
+    uint32_t errors() const { return errorCount; }
+
+    //------------------------------------------------------------------------------
+    // W1 search protocol
+    //------------------------------------------------------------------------------
+    /*!
+     * \brief findDevices - scans the 1-wire bus and returns found device ids
+     * \return list of found device ids
+     */
+    QList<uint64_t> findDevices();
+    /*!
+     * \brief findDevices - allocation free variant of findDevices()
+     * \param devices - receives the found device ids
+     * \param maxDevices - size of devices, the search stops when it is full
+     * \return number of found devices, -1 on failure
+     */
+    int findDevices(uint64_t *devices, int maxDevices);
+
+    //------------------------------------------------------------------------------
+    // Bridge configuration
+    //------------------------------------------------------------------------------
+    virtual int set_active_pullup(bool activePullup) = 0;
+    virtual int set_high_speed(bool highSpeed) = 0;
+    virtual int set_strong_pullup(bool strongPullup) = 0;
+
+    //------------------------------------------------------------------------------
+    // W1 primitives
+    //------------------------------------------------------------------------------
+    /*!
+     * \brief w1_reset
+     * \return 1 if presence pulse was detected, 0 when no presence pulse was detected, -1 on error
+     */
+    virtual int w1_reset() = 0;
+    virtual int w1_read_bit() = 0;
+    virtual int w1_write_bit(bit_t bit) = 0;
+
+    /*!
+     * \brief w1_write_byte
+     * \param byte - byte to be written
+     * \return 0 on success, -1 on failure
+     */
+    virtual int w1_write_byte(uint8_t byte) = 0;
+    /*!
+     * \brief w1_read_byte
+     * \return the byte on success, -1 on failure
+     */
+    virtual int w1_read_byte() = 0;
+
+    /*!
+     * \return len on success, -1 on failure
+     */
+    virtual int w1_read_block(uint8_t *buf, int len);
+    /*!
+     * \return 0 on success, -1 on failure
+     */
+    virtual int w1_write_block(uint8_t *buf, int len);
+
+    /*!
+     * \brief w1_triplet - one search step: reads a bit and its complement and
+     * writes the chosen direction
+     * \param dir - preferred direction, receives the direction taken
+     * \return 0 on success, -1 on failure
+     */
+    virtual int w1_triplet(bit_t *dir, bit_t *first_bit, bit_t *second_bit);
+
+    //------------------------------------------------------------------------------
+    // W1 ROM commands
+    //------------------------------------------------------------------------------
+    int w1_match_rom(uint64_t device);
+    /*!
+     * \brief w1_read_rom - reads the id of the only device on the bus, the
+     * caller has to reset the bus first
+     * \return 0 on success, -1 on failure, -2 on CRC errors
+     */
+    int w1_read_rom(uint64_t *device);
+    int w1_skip_rom();
+    int w1_resume();
+    int w1_overdrive_match_rom(uint64_t device);
+    int w1_overdrive_skip_rom();
+
+    //------------------------------------------------------------------------------
+    // DS2431 memory
+    //------------------------------------------------------------------------------
+    /*!
+     * \brief ds2431_read_memory - selects the device and reads its memory
+     * \param device - ROM id of the DS2431
+     * \param address - start address in the memory
+     * \param buf - destination buffer of len bytes
+     * \param len - number of bytes to read
+     * \return len on success, -1 on failure
+     */
+    int ds2431_read_memory(uint64_t device, int address, uint8_t *buf, int len);
+    /*!
+     * \brief ds2431_read_memory - reads the memory of the device selected
+     * before, e.g. with an overdrive match
+     * \return len on success, -1 on failure
+     */
+    int ds2431_read_memory(int address, uint8_t *buf, int len);
+
+    /*!
+     * \brief w1_log - prints an error unless logging is off and counts it,
+     * also used by helpers driving the bridge such as W1LinkTuner
+     */
+    void w1_log(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+    static bool w1_check_rom_crc(uint64_t dev);
+    static uint16_t w1_compute_data_crc(uint8_t *buf, int len);
+    /*!
+     * \brief w1_update_data_crc - continues a CRC16 over more bytes
+     * \param crc - running CRC, 0 to start or a precomputed seed
+     * \return running CRC, the value sent by devices is its complement
+     */
+    static uint16_t w1_update_data_crc(uint16_t crc, const uint8_t *buf, int len);
+
+protected:
+    struct w1_search_s {
+        void reset() {
+            last_device = 0;
+            start_search_from = -1;
+        }
+
+        w1_search_s() {
+            reset();
+        }
+
+        uint64_t last_device;
+        int start_search_from = -1;
+    };
+
+    /*!
+     * \brief w1_search_lowlevel - finds the next device of a search
+     * \return 1 if a device was found, 2 if it was the last one, 0 if there
+     * are no devices, -1 on failure
+     */
+    virtual int w1_search_lowlevel(w1_search_s *s);
+
+private:
+    bool logging = true;
+    uint32_t errorCount = 0;
+};
@@ -0,0 +1,228 @@
+#include "w1cache.h"
+
+#include <string.h>
+
+#include "w1clock.h"
+
+struct W1Cache::entry_s {
+    bool pending = true;
+    // length being read, or cached
+    int len = 0;
+    // incremented when a read finishes, waiters sleep until it changes
+    uint32_t sequence = 0;
+    int result = 0;
+    int64_t expiresUs = 0;
+    QByteArray data;
+};
+
+W1Cache::W1Cache(DS2482Bus &_bus)
+    : bus(_bus)
+{
+    memset(&statistics, 0, sizeof(statistics));
+}
+
+W1Cache::~W1Cache()
+{
+
+}
+
+void W1Cache::setTtl(int op, int ms)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    ttls.insert(op, ms);
+}
+
+void W1Cache::setClient(int _client)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    client = _client;
+}
+
+uint32_t W1Cache::entryKey(int op, int address)
+{
+    return ((uint32_t) op << 16) | (address & 0xFFFF);
+}
+
+W1Cache::entry_t W1Cache::lookup(uint64_t rom, uint32_t key)
+{
+    if (!entries.contains(rom))
+    {
+        return entry_t();
+    }
+
+    return entries[rom].value(key);
+}
+
+void W1Cache::remove(uint64_t rom, uint32_t key, const entry_t &entry)
+{
+    if (!entries.contains(rom))
+    {
+        return;
+    }
+
+    // the entry may already have been replaced by a newer read
+    QHash<uint32_t, entry_t> &device = entries[rom];
+    if (device.value(key) == entry)
+    {
+        device.remove(key);
+    }
+    if (device.isEmpty())
+    {
+        entries.remove(rom);
+    }
+}
+
+//------------------------------------------------------------------------------
+// Reads
+//------------------------------------------------------------------------------
+int W1Cache::read(uint64_t rom, int op, int address, uint8_t *buf, int len, fetch_t fetch,
+                  int ttlMs)
+{
+    uint32_t key = entryKey(op, address);
+
+    std::unique_lock<std::mutex> lock(mutex);
+
+    if (ttlMs < 0)
+    {
+        ttlMs = ttls.value(op, W1CACHE_DEFAULT_TTL_MS);
+    }
+
+    entry_t cached = lookup(rom, key);
+    if (cached != nullptr && cached->len >= len)
+    {
+        if (cached->pending)
+        {
+            // somebody is reading this right now, wait for the result
+            statistics.coalesced++;
+            uint32_t sequence = cached->sequence;
+            fetched.wait(lock, [&cached, sequence] { return cached->sequence != sequence; });
+
+            if (cached->result < 0)
+            {
+                return cached->result;
+            }
+            memcpy(buf, cached->data.constData(), len);
+            return len;
+        }
+
+        if (w1_now_us() < cached->expiresUs)
+        {
+            statistics.hits++;
+            memcpy(buf, cached->data.constData(), len);
+            return len;
+        }
+    }
+
+    // a shorter read in flight keeps its waiters, ours replaces its entry
+    statistics.misses++;
+    int64_t now = w1_now_us();
+    if (now >= nextPurgeUs)
+    {
+        purgeExpired(now);
+        nextPurgeUs = now + (int64_t) W1CACHE_PURGE_INTERVAL_MS * 1000;
+    }
+    entry_t entry = std::make_shared<entry_s>();
+    entry->len = len;
+    entries[rom].insert(key, entry);
+    int fetchClient = client;
+    lock.unlock();
+
+    int ret = bus.transact([&fetch, buf, len](DS2482 &ds) { return fetch(ds, buf, len); },
+                           fetchClient);
+    if (ret >= 0 && ret != len)
+    {
+        ret = -1;
+    }
+    now = w1_now_us();
+
+    lock.lock();
+    entry->pending = false;
+    entry->sequence++;
+    entry->result = ret;
+    if (ret >= 0)
+    {
+        entry->data = QByteArray((const char *) buf, len);
+        entry->expiresUs = now + (int64_t) ttlMs * 1000;
+    } else {
+        statistics.errors++;
+    }
+
+    if (ret < 0 || ttlMs == 0)
+    {
+        remove(rom, key, entry);
+    }
+    fetched.notify_all();
+
+    return ret;
+}
+
+int W1Cache::readMemory(uint64_t rom, int address, uint8_t *buf, int len, int ttlMs)
+{
+    return read(rom, OP_DS2431_MEMORY, address, buf, len,
+                [rom, address](DS2482 &ds, uint8_t *dest, int size) {
+                    return ds.ds2431_read_memory(rom, address, dest, size);
+                }, ttlMs);
+}
+
+//------------------------------------------------------------------------------
+// Maintenance
+//------------------------------------------------------------------------------
+void W1Cache::invalidate(uint64_t rom)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // reads in flight keep their entry alive, their result is not cached
+    entries.remove(rom);
+}
+
+void W1Cache::invalidate(uint64_t rom, int op, int address)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    uint32_t key = entryKey(op, address);
+    remove(rom, key, lookup(rom, key));
+}
+
+void W1Cache::purge()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    purgeExpired(w1_now_us());
+}
+
+void W1Cache::purgeExpired(int64_t now)
+{
+    foreach (uint64_t rom, entries.keys())
+    {
+        QHash<uint32_t, entry_t> &device = entries[rom];
+        foreach (uint32_t key, device.keys())
+        {
+            entry_t entry = device.value(key);
+            if (!entry->pending && now >= entry->expiresUs)
+            {
+                device.remove(key);
+            }
+        }
+        if (device.isEmpty())
+        {
+            entries.remove(rom);
+        }
+    }
+}
+
+void W1Cache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+}
+
+W1Cache::stats_t W1Cache::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return statistics;
+}
+
+void W1Cache::resetStats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    memset(&statistics, 0, sizeof(statistics));
+}
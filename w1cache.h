@@ -0,0 +1,109 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+#include "ds2482bus.h"
+
+#define W1CACHE_DEFAULT_TTL_MS 1000
+// reads that miss drop all expired entries at most this often
+#define W1CACHE_PURGE_INTERVAL_MS 10000
+
+/*!
+ * \class W1Cache
+ *
+ * \brief Read-through cache for device data in front of a DS2482Bus
+ *
+ * Results are keyed by (rom, operation, address) and kept for a TTL. When
+ * several threads ask the same question while it is being read from the
+ * bus, only the first one runs the transaction; the others wait for its
+ * result and count as coalesced. Failed reads are not cached, but their
+ * error is returned to every caller that waited for them.
+ *
+ * A cached or pending result answers requests for the same or a shorter
+ * length; a longer request reads again and replaces it. Writers have to
+ * invalidate what they change.
+ *
+ * Expired entries stay until a read replaces them or they are purged,
+ * which reads that miss do every W1CACHE_PURGE_INTERVAL_MS.
+ */
+class W1Cache
+{
+public:
+    enum op_t {
+        OP_DS2431_MEMORY = 0,
+        // first operation code for callers with their own fetch functions
+        OP_USER = 0x100
+    };
+
+    struct stats_t {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t coalesced;
+        uint64_t errors;
+    };
+
+    /*!
+     * \brief fetch function, runs inside a bus transaction
+     * \return number of bytes read into buf, negative on failure
+     */
+    typedef std::function<int(DS2482 &ds, uint8_t *buf, int len)> fetch_t;
+
+    W1Cache(DS2482Bus &bus);
+    ~W1Cache();
+
+    // default TTL of an operation, 0 only coalesces concurrent reads
+    void setTtl(int op, int ms);
+    // bus client the reads are charged to, see DS2482Bus::addClient()
+    void setClient(int client);
+
+    /*!
+     * \brief read - returns cached data or reads it once for all concurrent callers
+     * \param ttlMs - lifetime of a new result, -1 for the default of the operation
+     * \return len on success, the error of the fetch on failure
+     */
+    int read(uint64_t rom, int op, int address, uint8_t *buf, int len, fetch_t fetch,
+             int ttlMs = -1);
+    /*!
+     * \brief readMemory - cached ds2431_read_memory()
+     */
+    int readMemory(uint64_t rom, int address, uint8_t *buf, int len, int ttlMs = -1);
+
+    void invalidate(uint64_t rom);
+    void invalidate(uint64_t rom, int op, int address);
+    // drops all expired entries
+    void purge();
+    void clear();
+
+    stats_t stats() const;
+    void resetStats();
+
+private:
+    struct entry_s;
+
+    typedef std::shared_ptr<entry_s> entry_t;
+
+    static uint32_t entryKey(int op, int address);
+    entry_t lookup(uint64_t rom, uint32_t key);
+    void remove(uint64_t rom, uint32_t key, const entry_t &entry);
+    void purgeExpired(int64_t now);
+
+    DS2482Bus &bus;
+    int client = DS2482BUS_DEFAULT_CLIENT;
+
+    mutable std::mutex mutex;
+    std::condition_variable fetched;
+    // rom -> (op, address) -> entry, waiters keep a reference while they
+    // sleep so invalidating an entry being read is safe
+    QHash<uint64_t, QHash<uint32_t, entry_t> > entries;
+    QHash<int, int> ttls;
+    int64_t nextPurgeUs = 0;
+    stats_t statistics;
+};
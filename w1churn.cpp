@@ -0,0 +1,240 @@
+#include "w1churn.h"
+
+#include <QHash>
+#include <QVector>
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "w1linktuner.h"
+#include "w1romregistry.h"
+#include "w1simbridge.h"
+#include "w1simbus.h"
+
+#define W1CHURN_MAX_DEVICES 1024
+
+struct touch_s {
+    uint64_t rom;
+    uint64_t insertUs;
+    uint64_t releaseUs;
+    int64_t foundUs;
+    int64_t removedUs;
+};
+
+static W1ChurnBenchmark::latency_t percentiles(QVector<int64_t> &values)
+{
+    W1ChurnBenchmark::latency_t result = { 0, 0, 0, 0 };
+    if (values.isEmpty())
+    {
+        return result;
+    }
+
+    std::sort(values.begin(), values.end());
+    int n = values.count();
+    result.p50 = values[(n - 1) * 50 / 100];
+    result.p90 = values[(n - 1) * 90 / 100];
+    result.p99 = values[(n - 1) * 99 / 100];
+    result.max = values[n - 1];
+
+    return result;
+}
+
+W1ChurnBenchmark::W1ChurnBenchmark()
+    : rng(0x9E3779B97F4A7C15ULL)
+{
+
+}
+
+void W1ChurnBenchmark::setDevices(int count)
+{
+    devices = count;
+}
+
+void W1ChurnBenchmark::setTouchRate(double perMinute)
+{
+    touchesPerMinute = perMinute;
+}
+
+void W1ChurnBenchmark::setHoldTime(int minMs, int maxMs)
+{
+    holdMinMs = minMs;
+    holdMaxMs = maxMs;
+}
+
+void W1ChurnBenchmark::setDuration(int seconds)
+{
+    durationS = seconds;
+}
+
+void W1ChurnBenchmark::setScanInterval(int ms)
+{
+    scanIntervalMs = ms;
+}
+
+void W1ChurnBenchmark::setBridgeOverhead(int us)
+{
+    overheadUs = us;
+}
+
+void W1ChurnBenchmark::setSeed(uint64_t seed)
+{
+    rng = seed != 0 ? seed : 1;
+}
+
+double W1ChurnBenchmark::random()
+{
+    // xorshift64*, runs are reproducible for a seed
+    rng ^= rng >> 12;
+    rng ^= rng << 25;
+    rng ^= rng >> 27;
+    return ((rng * 0x2545F4914F6CDD1DULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+int W1ChurnBenchmark::run(result_t *result)
+{
+    if (devices < 0 || devices > W1CHURN_MAX_DEVICES / 2 || touchesPerMinute < 0
+            || holdMinMs < 0 || holdMaxMs < holdMinMs)
+    {
+        fprintf(stderr, "Invalid churn scenario\n");
+        return -1;
+    }
+
+    W1SimBus bus;
+    for (int i = 0; i < devices; i++)
+    {
+        bus.addDevice(W1SimBus::makeRom(DS2431_FAMILY_CODE, 0x1000 + i * 0x10001ULL));
+    }
+
+    // script all touches up front
+    uint64_t durationUs = (uint64_t) durationS * 1000000;
+    QVector<touch_s> touches;
+    QHash<uint64_t, int> touchIndex;
+    double t = 0;
+    while (touchesPerMinute > 0)
+    {
+        t -= log(1.0 - random()) * 60e6 / touchesPerMinute;
+        if (t >= durationUs)
+        {
+            break;
+        }
+
+        touch_s touch;
+        touch.rom = W1SimBus::makeRom(W1CHURN_TOUCH_FAMILY, 0x100000 + touches.count());
+        touch.insertUs = (uint64_t) t;
+        touch.releaseUs = touch.insertUs + (uint64_t) (1000 * (holdMinMs
+                                                      + random() * (holdMaxMs - holdMinMs)));
+        touch.foundUs = -1;
+        touch.removedUs = -1;
+        bus.scheduleAdd(touch.insertUs, touch.rom);
+        bus.scheduleRemove(touch.releaseUs, touch.rom);
+        touchIndex.insert(touch.rom, touches.count());
+        touches << touch;
+    }
+
+    W1SimBridge ds(bus);
+    ds.setOverhead(overheadUs);
+    ds.setLogging(false);
+    W1LinkTuner tuner;
+    W1RomRegistry registry(devices * 2);
+
+    static uint64_t found[W1CHURN_MAX_DEVICES];
+    static uint64_t added[W1CHURN_MAX_DEVICES];
+    static uint64_t removed[W1CHURN_MAX_DEVICES];
+
+    memset(result, 0, sizeof(*result));
+    result->devices = devices;
+    result->touchesPerMinute = touchesPerMinute;
+    result->touches = touches.count();
+
+    // let the last touch finish so its removal can be seen
+    uint64_t endUs = durationUs + (uint64_t) holdMaxMs * 1000 + 1000000;
+    uint64_t searchUs = 0;
+    while (bus.nowUs() < endUs)
+    {
+        uint64_t start = bus.nowUs();
+        int count = -1;
+        if (tuner.prepareSearch(ds) == 0)
+        {
+            count = ds.findDevices(found, W1CHURN_MAX_DEVICES);
+        }
+        tuner.report(0, count >= 0);
+        uint64_t now = bus.nowUs();
+        searchUs += now - start;
+        result->scans++;
+
+        if (count < 0)
+        {
+            result->failedScans++;
+        } else {
+            int addedCount, removedCount;
+            registry.reconcile(0, found, count, added, &addedCount, removed, &removedCount);
+
+            for (int i = 0; i < addedCount; i++)
+            {
+                int index = touchIndex.value(added[i], -1);
+                if (index >= 0 && touches[index].foundUs < 0)
+                {
+                    touches[index].foundUs = now;
+                }
+            }
+            for (int i = 0; i < removedCount; i++)
+            {
+                // a device that is still plugged in was lost by the search
+                int index = touchIndex.value(removed[i], -1);
+                if (index < 0 || now < touches[index].releaseUs)
+                {
+                    result->spurious++;
+                } else if (touches[index].removedUs < 0) {
+                    touches[index].removedUs = now;
+                }
+            }
+        }
+
+        bus.idle((uint64_t) scanIntervalMs * 1000);
+    }
+
+    QVector<int64_t> insertLatency;
+    QVector<int64_t> removeLatency;
+    foreach (const touch_s &touch, touches)
+    {
+        if (touch.foundUs < 0)
+        {
+            result->missed++;
+            continue;
+        }
+
+        result->detected++;
+        insertLatency << touch.foundUs - (int64_t) touch.insertUs;
+        if (touch.removedUs < 0)
+        {
+            result->missedRemovals++;
+        } else {
+            removeLatency << touch.removedUs - (int64_t) touch.releaseUs;
+        }
+    }
+
+    result->insert = percentiles(insertLatency);
+    result->remove = percentiles(removeLatency);
+    result->scanMs = result->scans > 0 ? searchUs / 1000.0 / result->scans : 0;
+    result->utilisation = (double) bus.timeUs() / bus.nowUs();
+
+    return 0;
+}
+
+void W1ChurnBenchmark::printHeader(FILE *f)
+{
+    fprintf(f, "%7s %7s %7s %6s %6s %6s %6s %8s %6s %5s   %-23s   %-23s\n",
+            "devices", "touch/m", "touches", "missed", "unrem", "spur", "scans", "scan ms",
+            "fail", "util", "found p50/p90/p99 ms", "removed p50/p90/p99 ms");
+}
+
+void W1ChurnBenchmark::printResult(FILE *f, const result_t &r)
+{
+    fprintf(f, "%7d %7.0f %7d %6d %6d %6d %6d %8.1f %6d %4.0f%%   %7.1f %7.1f %7.1f   %7.1f %7.1f %7.1f\n",
+            r.devices, r.touchesPerMinute, r.touches, r.missed, r.missedRemovals, r.spurious,
+            r.scans, r.scanMs, r.failedScans, r.utilisation * 100,
+            r.insert.p50 / 1000.0, r.insert.p90 / 1000.0, r.insert.p99 / 1000.0,
+            r.remove.p50 / 1000.0, r.remove.p90 / 1000.0, r.remove.p99 / 1000.0);
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define W1CHURN_TOUCH_FAMILY   0x01   // DS1990A iButton
+
+/*!
+ * \class W1ChurnBenchmark
+ *
+ * \brief Hot-plug scenario on a simulated bus measuring how fast the scan
+ * loop notices devices coming and going
+ *
+ * A fixed population of devices stays on the bus while iButtons are
+ * touched to it: touches arrive as a Poisson process and every one holds
+ * its contact for a random time. The scan loop is the one of main.cpp, a
+ * link tuner prepared search, findDevices() and a W1RomRegistry diff,
+ * followed by the scan interval. Everything runs on the simulated clock.
+ */
+class W1ChurnBenchmark
+{
+public:
+    struct latency_t {
+        int64_t p50;
+        int64_t p90;
+        int64_t p99;
+        int64_t max;
+    };
+
+    struct result_t {
+        int devices;
+        double touchesPerMinute;
+        int touches;
+        int detected;           // touches seen by at least one scan
+        int missed;             // touches that came and went unseen
+        int missedRemovals;     // detected touches never reported removed
+        int spurious;           // removals of devices that never left
+        int scans;
+        int failedScans;
+        double scanMs;          // average duration of one search
+        double utilisation;     // bus time / elapsed time
+        latency_t insert;       // touch to found, in us
+        latency_t remove;       // release to removed, in us
+    };
+
+    W1ChurnBenchmark();
+
+    void setDevices(int count);
+    void setTouchRate(double perMinute);
+    void setHoldTime(int minMs, int maxMs);
+    void setDuration(int seconds);
+    void setScanInterval(int ms);
+    /*!
+     * \brief setBridgeOverhead - time per bridge primitive, see W1SimBridge
+     */
+    void setBridgeOverhead(int us);
+    void setSeed(uint64_t seed);
+
+    /*!
+     * \brief run - runs one scenario
+     * \return 0 on success, -1 on failure
+     */
+    int run(result_t *result);
+
+    static void printHeader(FILE *f);
+    static void printResult(FILE *f, const result_t &result);
+
+private:
+    double random();
+
+    int devices = 0;
+    double touchesPerMinute = 200;
+    int holdMinMs = 250;
+    int holdMaxMs = 1500;
+    int durationS = 60;
+    int scanIntervalMs = 100;
+    int overheadUs = 0;
+    uint64_t rng;
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+/*!
+ * \brief w1_now_us - CLOCK_MONOTONIC in us, the time base of all schedules,
+ * timeouts and the shm, trace and telemetry timestamps
+ */
+static inline int64_t w1_now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*!
+ * \brief w1_realtime_us - CLOCK_REALTIME in us, only for wall clock records
+ */
+static inline int64_t w1_realtime_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*!
+ * \brief w1_sleep_until_us - sleeps until a w1_now_us() time, returns at once
+ * if it has passed
+ */
+static inline void w1_sleep_until_us(int64_t us)
+{
+    struct timespec ts;
+    ts.tv_sec = us / 1000000;
+    ts.tv_nsec = (us % 1000000) * 1000;
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
@@ -0,0 +1,811 @@
+#include "w1daemon.h"
+
+#include <QVector>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "w1clock.h"
+
+#define W1DAEMON_COMMAND_PERIOD_MS 20
+#define W1DAEMON_MAX_LINE          256
+// extra tries of a device read that failed, e.g. on a CRC error
+#define W1DAEMON_READ_RETRIES      1
+
+// registry metadata, what the inventory last heard about a device
+#define W1DAEMON_META_FLAGS        0
+#define W1DAEMON_META_HASH         1
+
+W1Daemon::W1Daemon(DS2482 &_ds)
+    : ds(_ds), scheduler(_ds), scanRequested(true), tuner(W1DAEMON_MAX_DEVICES)
+{
+    // reconcile() reserves the known plus the found devices, which never
+    // passes this, so the table does not grow on the bus thread
+    registry.reserve(2 * W1DAEMON_MAX_DEVICES);
+}
+
+W1Daemon::~W1Daemon()
+{
+    close();
+}
+
+void W1Daemon::setScanInterval(int ms)
+{
+    scanIntervalMs = ms;
+}
+
+void W1Daemon::setReadingPeriod(int ms)
+{
+    readingPeriodMs = ms;
+}
+
+void W1Daemon::setRealtime(int priority, int cpu)
+{
+    rtPriority = priority;
+    rtCpu = cpu;
+}
+
+void W1Daemon::setTelemetry(W1TelemetryWriter *_telemetry)
+{
+    telemetry = _telemetry;
+}
+
+void W1Daemon::setInventory(W1Inventory *_inventory, QString fileName, QString bus)
+{
+    inventory = _inventory;
+    inventoryFile = fileName;
+    inventoryBus = bus;
+}
+
+int W1Daemon::open(QString shmName, QString _socketPath)
+{
+    if (shm.open(shmName) != 0)
+    {
+        return -1;
+    }
+
+    if (shmReader.open(shmName) != 0)
+    {
+        close();
+        return -1;
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    QByteArray path = _socketPath.toLocal8Bit();
+    if (path.size() >= (int) sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "Socket path too long: %s\n", path.constData());
+        close();
+        return -1;
+    }
+    strcpy(addr.sun_path, path.constData());
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (listenFd < 0)
+    {
+        fprintf(stderr, "Could not create socket: %m\n");
+        close();
+        return -1;
+    }
+
+    unlink(path.constData());
+    if (bind(listenFd, (struct sockaddr *) &addr, sizeof(addr)) != 0
+            || listen(listenFd, 8) != 0)
+    {
+        fprintf(stderr, "Could not listen on %s: %m\n", path.constData());
+        close();
+        return -1;
+    }
+    socketPath = _socketPath;
+
+    wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (wakeFd < 0)
+    {
+        fprintf(stderr, "Could not create eventfd: %m\n");
+        close();
+        return -1;
+    }
+
+    scheduler.addJob("commands", W1DAEMON_COMMAND_PERIOD_MS, 2,
+                     [this](DS2482 &ds) { return commandJob(ds); });
+    scheduler.addJob("readings", readingPeriodMs, 1,
+                     [this](DS2482 &ds) { return readingJob(ds); });
+    // known devices are served right away, the full search is postponed and
+    // confirms them later; a read failing before that brings it forward
+    int scanDelayMs = 0;
+    QList<w1inventory_entry_t> entries;
+    if (inventory != nullptr)
+    {
+        entries = inventory->entries(inventoryBus).mid(0, W1DAEMON_MAX_DEVICES);
+    }
+    if (!entries.isEmpty())
+    {
+        int count = 0;
+        foreach (const w1inventory_entry_t &entry, entries)
+        {
+            known[count++] = entry.rom;
+        }
+        // the bus thread is not running yet
+        updateDevices(known, count);
+        foreach (const w1inventory_entry_t &entry, entries)
+        {
+            int slot = registry.find(entry.rom);
+            registry.meta(slot, W1DAEMON_META_FLAGS) = entry.flags;
+            registry.meta(slot, W1DAEMON_META_HASH) = entry.memoryHash;
+        }
+
+        warmStart = true;
+        scanRequested = false;
+        scanDelayMs = scanIntervalMs;
+    }
+    nextScanUs = w1_now_us() + (int64_t) scanDelayMs * 1000;
+    scheduler.setBackgroundJob("scan", scanIntervalMs,
+                               [this](DS2482 &ds) { return scanJob(ds); }, scanDelayMs);
+
+    return 0;
+}
+
+void W1Daemon::close()
+{
+    foreach (int fd, clients.keys())
+    {
+        closeClient(fd);
+    }
+
+    if (listenFd != -1)
+    {
+        ::close(listenFd);
+        listenFd = -1;
+        unlink(socketPath.toLocal8Bit().constData());
+    }
+
+    if (wakeFd != -1)
+    {
+        ::close(wakeFd);
+        wakeFd = -1;
+    }
+
+    shmReader.close();
+    shm.close();
+}
+
+//------------------------------------------------------------------------------
+// Bus thread
+//------------------------------------------------------------------------------
+int W1Daemon::scanJob(DS2482 &ds)
+{
+    scanRequested = false;
+    nextScanUs = w1_now_us() + (int64_t) scanIntervalMs * 1000;
+
+    uint64_t found[W1DAEMON_MAX_DEVICES];
+    int count = -1;
+    if (tuner.prepareSearch(ds) == 0)
+    {
+        count = ds.findDevices(found, W1DAEMON_MAX_DEVICES);
+    }
+    tuner.report(0, count >= 0);
+    if (count < 0)
+    {
+        // keep the last inventory, a broken search does not remove devices
+        return -1;
+    }
+
+    warmStart = false;
+    updateDevices(found, count);
+
+    return 0;
+}
+
+void W1Daemon::updateDevices(const uint64_t *found, int count)
+{
+    int addedCount, removedCount;
+    registry.reconcile(0, found, count, added, &addedCount, removed, &removedCount);
+
+    for (int i = 0; i < removedCount; i++)
+    {
+        tuner.forget(removed[i]);
+    }
+
+    // a lost device event would leave the socket thread with a wrong list,
+    // the whole list is sent again instead; a running resync starts over
+    if (resyncNext >= 0 && (addedCount > 0 || removedCount > 0))
+    {
+        resyncNext = 0;
+    }
+    for (int i = 0; i < addedCount && resyncNext < 0; i++)
+    {
+        if (!queueEvent(EVENT_FOUND, added[i]))
+        {
+            resyncNext = 0;
+        }
+    }
+    for (int i = 0; i < removedCount && resyncNext < 0; i++)
+    {
+        if (!queueEvent(EVENT_REMOVED, removed[i]))
+        {
+            resyncNext = 0;
+        }
+    }
+
+    memcpy(devices, found, count * sizeof(uint64_t));
+    deviceCount = count;
+    flushResync();
+    int dropped = shm.publishInventory(devices, deviceCount, w1_now_us());
+    if (dropped > 0)
+    {
+        queueEvent(EVENT_SHM_FULL, 0, dropped);
+    }
+
+    wakeSocketThread();
+}
+
+void W1Daemon::flushResync()
+{
+    if (telemetry == nullptr && inventory == nullptr)
+    {
+        resyncNext = -1;
+        return;
+    }
+
+    bool queued = false;
+    while (resyncNext >= 0)
+    {
+        event_s event;
+        event.type = resyncNext == 0 ? EVENT_RESYNC_START
+                   : resyncNext <= deviceCount ? EVENT_FOUND : EVENT_RESYNC_END;
+        event.rom = resyncNext > 0 && resyncNext <= deviceCount ? devices[resyncNext - 1] : 0;
+        event.result = 0;
+        event.len = 0;
+        // not a drop, the rest is queued on the next call
+        if (!events.push(event))
+        {
+            break;
+        }
+        queued = true;
+
+        resyncNext = resyncNext > deviceCount ? -1 : resyncNext + 1;
+    }
+
+    if (queued)
+    {
+        wakeSocketThread();
+    }
+}
+
+int W1Daemon::readingJob(DS2482 &ds)
+{
+    int ret = 0;
+
+    for (int i = 0; i < deviceCount; i++)
+    {
+        uint64_t rom = devices[i];
+        if ((rom & 0xFF) != DS2431_FAMILY_CODE)
+        {
+            continue;
+        }
+
+        uint8_t buf[W1SHM_READING_SIZE];
+        bool ok = readDevice(ds, rom, 0, buf, sizeof(buf), true) == 0;
+        if (!ok)
+        {
+            // the device may be gone since the inventory was saved
+            if (warmStart)
+            {
+                scanRequested = true;
+            }
+            ret = -1;
+            continue;
+        }
+
+        shm.publishReading(rom, buf, sizeof(buf), w1_now_us());
+        queueEvent(EVENT_READING, rom, 0, buf, sizeof(buf));
+        recordDevice(rom, buf, sizeof(buf));
+    }
+    wakeSocketThread();
+
+    return ret;
+}
+
+int W1Daemon::readDevice(DS2482 &ds, uint64_t rom, int address, uint8_t *buf, int len,
+                         bool report)
+{
+    int retries = 0;
+    bool ok;
+    for (;;)
+    {
+        ok = tuner.select(ds, rom) == 0 && ds.ds2431_read_memory(address, buf, len) >= 0;
+        if (ok || retries == W1DAEMON_READ_RETRIES)
+        {
+            break;
+        }
+        retries++;
+    }
+
+    if (report)
+    {
+        tuner.report(rom, ok, retries);
+    }
+
+    return ok ? 0 : -1;
+}
+
+void W1Daemon::recordDevice(uint64_t rom, const uint8_t *buf, int len)
+{
+    int slot = registry.find(rom);
+    if (slot == W1ROMREGISTRY_NONE)
+    {
+        return;
+    }
+
+    // a read that worked in overdrive proves the device supports it, the
+    // flag stays when the tuner steps down later
+    uint64_t &flags = registry.meta(slot, W1DAEMON_META_FLAGS);
+    uint64_t newFlags = flags;
+    if (tuner.mode(rom).overdrive)
+    {
+        newFlags |= W1INVENTORY_FLAG_OVERDRIVE;
+    }
+    if (newFlags != flags && queueEvent(EVENT_FLAGS, rom, newFlags))
+    {
+        flags = newFlags;
+    }
+
+    // only the polled part of the memory is hashed
+    uint64_t &hash = registry.meta(slot, W1DAEMON_META_HASH);
+    uint32_t newHash = W1Inventory::hashMemory(buf, len);
+    if (newHash != hash && queueEvent(EVENT_MEMORY_HASH, rom, (int) newHash))
+    {
+        hash = newHash;
+    }
+}
+
+int W1Daemon::commandJob(DS2482 &ds)
+{
+    // a search is longer than the gaps between command runs, so the
+    // background job alone would hardly ever find room for it
+    if (scanRequested || w1_now_us() >= nextScanUs)
+    {
+        scanJob(ds);
+    }
+    flushResync();
+
+    command_s cmd;
+    bool replied = false;
+    while (commands.pop(&cmd))
+    {
+        reply_s r;
+        r.fd = cmd.fd;
+        r.len = cmd.len;
+        // unknown devices would only fill the tuner with typos
+        r.result = readDevice(ds, cmd.rom, cmd.address, r.data, cmd.len,
+                              registry.contains(cmd.rom));
+
+        // the socket thread limits the commands in flight to the queue size
+        replies.push(r);
+        replied = true;
+    }
+    if (replied)
+    {
+        wakeSocketThread();
+    }
+
+    return 0;
+}
+
+bool W1Daemon::queueEvent(event_type_t type, uint64_t rom, int result,
+                          const uint8_t *data, int len)
+{
+    // telemetry and the inventory need the device events, only telemetry the
+    // readings and only the inventory the metadata
+    if ((type == EVENT_FOUND || type == EVENT_REMOVED)
+            && telemetry == nullptr && inventory == nullptr)
+    {
+        return true;
+    }
+    if (type == EVENT_READING && telemetry == nullptr)
+    {
+        return true;
+    }
+    if ((type == EVENT_FLAGS || type == EVENT_MEMORY_HASH) && inventory == nullptr)
+    {
+        return true;
+    }
+
+    event_s event;
+    event.type = type;
+    event.rom = rom;
+    event.result = result;
+    event.len = len;
+    if (len > 0)
+    {
+        memcpy(event.data, data, len);
+    }
+
+    if (!events.push(event))
+    {
+        droppedEvents++;
+        return false;
+    }
+
+    return true;
+}
+
+void W1Daemon::wakeSocketThread()
+{
+    // never blocks, the counter is far from overflowing
+    uint64_t one = 1;
+    ssize_t ret = write(wakeFd, &one, sizeof(one));
+    (void) ret;
+}
+
+//------------------------------------------------------------------------------
+// Socket thread
+//------------------------------------------------------------------------------
+int W1Daemon::run(const std::atomic<bool> *stop)
+{
+    if (listenFd == -1)
+    {
+        fprintf(stderr, "Daemon is not open\n");
+        return -1;
+    }
+
+    W1RealtimeThread busThread;
+    busThread.setPriority(rtPriority);
+    busThread.setCpu(rtCpu);
+    busThread.setLockMemory(rtPriority > 0);
+
+    busStop = false;
+    ds.setLogging(rtPriority == 0);
+    if (busThread.start([this] { scheduler.run(&busStop); }) != 0)
+    {
+        ds.setLogging(true);
+        return -1;
+    }
+
+    while (!*stop && !quitRequested)
+    {
+        QVector<struct pollfd> fds;
+        struct pollfd pfd;
+        pfd.fd = listenFd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        fds << pfd;
+        pfd.fd = wakeFd;
+        fds << pfd;
+        foreach (int fd, clients.keys())
+        {
+            pfd.fd = fd;
+            fds << pfd;
+        }
+
+        int ret = poll(fds.data(), fds.count(), 200);
+        if (ret < 0 && errno != EINTR)
+        {
+            fprintf(stderr, "poll failed: %m\n");
+            break;
+        }
+
+        handleBusEvents();
+        if (ret <= 0)
+        {
+            continue;
+        }
+
+        for (int i = 2; i < fds.count(); i++)
+        {
+            if (fds[i].revents != 0 && handleClient(fds[i].fd) != 0)
+            {
+                closeClient(fds[i].fd);
+            }
+        }
+        if (fds[0].revents & POLLIN)
+        {
+            acceptClient();
+        }
+    }
+
+    busStop = true;
+    busThread.join();
+    ds.setLogging(true);
+
+    handleBusEvents();
+    command_s cmd;
+    while (commands.pop(&cmd))
+    {
+        reply(cmd.fd, "ERR daemon stopped\n");
+        ::close(cmd.fd);
+    }
+
+    scheduler.printReport(stderr);
+    tuner.printReport(stderr);
+
+    return 0;
+}
+
+void W1Daemon::handleBusEvents()
+{
+    uint64_t value;
+    ssize_t len = read(wakeFd, &value, sizeof(value));
+    (void) len;
+
+    reply_s r;
+    while (replies.pop(&r))
+    {
+        pendingCommands--;
+        if (r.result != 0)
+        {
+            reply(r.fd, "ERR read failed\n");
+        } else {
+            QByteArray hex = QByteArray((const char *) r.data, r.len).toHex();
+            reply(r.fd, "OK %s\n", hex.constData());
+        }
+
+        // the socket thread handed the bus thread a duplicate of the client fd
+        ::close(r.fd);
+    }
+
+    event_s event;
+    while (events.pop(&event))
+    {
+        switch (event.type)
+        {
+        case EVENT_FOUND:
+        case EVENT_REMOVED:
+        case EVENT_RESYNC_START:
+        case EVENT_RESYNC_END:
+            handleDeviceEvent(event);
+            break;
+        case EVENT_READING:
+            telemetry->logReading(event.rom, event.data, event.len);
+            break;
+        case EVENT_FLAGS:
+        case EVENT_MEMORY_HASH:
+            // the device may have been found by an event of this batch
+            syncInventory();
+            if (event.type == EVENT_FLAGS
+                    ? inventory->setFlags(inventoryBus, event.rom, event.result)
+                    : inventory->setMemoryHash(inventoryBus, event.rom, (uint32_t) event.result))
+            {
+                inventoryDirty = true;
+            }
+            break;
+        case EVENT_SHM_FULL:
+            fprintf(stderr, "Too many devices for shared memory, dropping %d\n", event.result);
+            break;
+        }
+    }
+
+    uint32_t drops = droppedEvents;
+    if (drops != reportedDrops)
+    {
+        fprintf(stderr, "Event queue full, %u events dropped\n", drops - reportedDrops);
+        reportedDrops = drops;
+    }
+
+    if (inventory != nullptr)
+    {
+        syncInventory();
+        if (inventoryDirty)
+        {
+            inventory->save(inventoryFile);
+            inventoryDirty = false;
+        }
+    }
+}
+
+void W1Daemon::handleDeviceEvent(const event_s &event)
+{
+    switch (event.type)
+    {
+    case EVENT_FOUND:
+        if (resyncing)
+        {
+            resyncDevices << event.rom;
+            return;
+        }
+        if (!presentDevices.contains(event.rom))
+        {
+            presentDevices << event.rom;
+        }
+        break;
+    case EVENT_REMOVED:
+        presentDevices.removeAll(event.rom);
+        break;
+    case EVENT_RESYNC_START:
+        resyncing = true;
+        resyncDevices.clear();
+        return;
+    case EVENT_RESYNC_END:
+        // telemetry gets the changes hidden in the dropped events
+        if (telemetry != nullptr)
+        {
+            foreach (uint64_t rom, resyncDevices)
+            {
+                if (!presentDevices.contains(rom))
+                {
+                    telemetry->logEvent(rom, W1TLM_FOUND);
+                }
+            }
+            foreach (uint64_t rom, presentDevices)
+            {
+                if (!resyncDevices.contains(rom))
+                {
+                    telemetry->logEvent(rom, W1TLM_REMOVED);
+                }
+            }
+        }
+        presentDevices = resyncDevices;
+        resyncDevices.clear();
+        resyncing = false;
+        devicesChanged = true;
+        return;
+    default:
+        return;
+    }
+
+    if (telemetry != nullptr)
+    {
+        telemetry->logEvent(event.rom, event.type == EVENT_FOUND ? W1TLM_FOUND : W1TLM_REMOVED);
+    }
+    devicesChanged = true;
+}
+
+void W1Daemon::syncInventory()
+{
+    // a half received resync is not the bus
+    if (!devicesChanged || resyncing)
+    {
+        return;
+    }
+    devicesChanged = false;
+
+    if (inventory->setDevices(inventoryBus, presentDevices))
+    {
+        inventoryDirty = true;
+    }
+}
+
+void W1Daemon::acceptClient()
+{
+    int fd = accept4(listenFd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Could not accept client: %m\n");
+        return;
+    }
+
+    clients.insert(fd, QByteArray());
+}
+
+void W1Daemon::closeClient(int fd)
+{
+    clients.remove(fd);
+    ::close(fd);
+}
+
+int W1Daemon::handleClient(int fd)
+{
+    char buf[W1DAEMON_MAX_LINE];
+    ssize_t len = recv(fd, buf, sizeof(buf), 0);
+    if (len <= 0)
+    {
+        return (len < 0 && errno == EAGAIN) ? 0 : -1;
+    }
+
+    QByteArray &pending = clients[fd];
+    pending.append(buf, len);
+
+    int eol;
+    while ((eol = pending.indexOf('\n')) >= 0)
+    {
+        QByteArray line = pending.left(eol).trimmed();
+        pending.remove(0, eol + 1);
+
+        if (handleCommand(fd, line) != 0)
+        {
+            return -1;
+        }
+    }
+
+    if (pending.size() > W1DAEMON_MAX_LINE)
+    {
+        reply(fd, "ERR line too long\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+int W1Daemon::handleCommand(int fd, const QByteArray &line)
+{
+    QList<QByteArray> args = line.split(' ');
+    QByteArray cmd = args.isEmpty() ? QByteArray() : args.first();
+
+    if (cmd == "list")
+    {
+        uint64_t now = w1_now_us();
+        bool ok;
+        QList<w1shm_device_t> entries = shmReader.devices(&ok);
+        if (!ok)
+        {
+            reply(fd, "ERR no consistent snapshot\n");
+            return 0;
+        }
+        foreach (const w1shm_device_t &dev, entries)
+        {
+            QByteArray reading = QByteArray((const char *) dev.reading, dev.readingLen).toHex();
+            reply(fd, "%016llx %llu %s\n", (unsigned long long) dev.rom,
+                  (unsigned long long) (dev.readingUs ? (now - dev.readingUs) / 1000 : 0),
+                  reading.constData());
+        }
+        reply(fd, "OK\n");
+    } else if (cmd == "scan") {
+        scanRequested = true;
+        reply(fd, "OK\n");
+    } else if (cmd == "read" && args.count() == 4) {
+        bool ok1, ok2, ok3;
+        command_s c;
+        c.rom = args[1].toULongLong(&ok1, 16);
+        c.address = args[2].toInt(&ok2, 16);
+        c.len = args[3].toInt(&ok3, 16);
+        if (!ok1 || !ok2 || !ok3 || c.address < 0 || c.len <= 0
+                || c.address + c.len > DS2431_MEMORY_SIZE)
+        {
+            reply(fd, "ERR invalid arguments\n");
+            return 0;
+        }
+
+        if (pendingCommands >= W1DAEMON_COMMAND_QUEUE)
+        {
+            reply(fd, "ERR busy\n");
+            return 0;
+        }
+
+        c.fd = dup(fd);
+        if (c.fd < 0)
+        {
+            reply(fd, "ERR %m\n");
+            return 0;
+        }
+
+        // can not fail, at most W1DAEMON_COMMAND_QUEUE commands are in flight
+        commands.push(c);
+        pendingCommands++;
+    } else if (cmd == "quit") {
+        quitRequested = true;
+        reply(fd, "OK\n");
+    } else {
+        reply(fd, "ERR unknown command\n");
+    }
+
+    return 0;
+}
+
+void W1Daemon::reply(int fd, const char *fmt, ...)
+{
+    char buf[512];
+
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+
+    if (len > (int) sizeof(buf) - 1)
+    {
+        len = sizeof(buf) - 1;
+    }
+
+    // clients that went away are cleaned up by the socket thread
+    send(fd, buf, len, MSG_NOSIGNAL);
+}
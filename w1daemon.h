@@ -0,0 +1,220 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+
+#include <atomic>
+
+#include "ds2482.h"
+#include "w1inventory.h"
+#include "w1linktuner.h"
+#include "w1romregistry.h"
+#include "w1rtthread.h"
+#include "w1scheduler.h"
+#include "w1shm.h"
+#include "w1spscqueue.h"
+#include "w1telemetry.h"
+
+#define W1DAEMON_DEFAULT_SOCKET "/tmp/onewire.sock"
+#define W1DAEMON_MAX_DEVICES    1024
+// read commands in flight between the socket thread and the bus thread
+#define W1DAEMON_COMMAND_QUEUE  16
+#define W1DAEMON_EVENT_QUEUE    256
+
+/*!
+ * \class W1Daemon
+ *
+ * \brief Bus daemon owning a DS2482
+ *
+ * A bus thread scans the bus and polls readings with a W1Scheduler and
+ * publishes them into a W1ShmWriter segment. Bus speed and pullup mode of
+ * every transaction are chosen by a W1LinkTuner. The calling thread serves a
+ * line based command protocol on a unix socket:
+ *
+ *   list                       - inventory and readings (served from shm)
+ *   scan                       - request a discovery scan
+ *   read <rom> <address> <len> - read DS2431 memory (hex arguments)
+ *   quit                       - stop the daemon
+ *
+ * Every command is answered with "OK ..." or "ERR ...".
+ *
+ * The bus thread does not allocate, print or touch files and sockets. Read
+ * commands reach it through a lock-free queue; replies, telemetry records
+ * and inventory updates go back the same way and are handled by the socket
+ * thread, which is woken through an eventfd.
+ */
+class W1Daemon
+{
+public:
+    W1Daemon(DS2482 &ds);
+    ~W1Daemon();
+
+    /*!
+     * \brief open - creates the shared memory segment and the command socket
+     * \return 0 on success, -1 on failure
+     */
+    int open(QString shmName, QString socketPath);
+    void close();
+
+    // intervals have to be set before open()
+    void setScanInterval(int ms);
+    void setReadingPeriod(int ms);
+    /*!
+     * \brief setInventory - publishes the known devices of the bus at open()
+     * and postpones the full scan, which then confirms them; keeps the
+     * inventory file up to date, including flags and memory hashes
+     * \param inventory - loaded inventory, not owned, must be set before open()
+     * \param fileName - file the inventory is saved to when the bus changes
+     * \param bus - key of the bus in the inventory
+     */
+    void setInventory(W1Inventory *inventory, QString fileName, QString bus);
+    /*!
+     * \brief setRealtime - runs the bus thread with SCHED_FIFO, see W1RealtimeThread,
+     * bridge errors are only counted while it runs
+     * \param priority - SCHED_FIFO priority, 0 for the default scheduler
+     * \param cpu - CPU the bus thread is pinned to, -1 for no affinity
+     */
+    void setRealtime(int priority, int cpu);
+    /*!
+     * \brief setTelemetry - logs found/removed devices and all readings
+     * \param telemetry - open log, not owned, nullptr disables logging
+     */
+    void setTelemetry(W1TelemetryWriter *telemetry);
+
+    /*!
+     * \brief run - serves clients until *stop becomes true or "quit" is received
+     * \return 0 on clean shutdown, -1 on failure
+     */
+    int run(const std::atomic<bool> *stop);
+
+private:
+    struct command_s {
+        int fd;
+        uint64_t rom;
+        int address;
+        int len;
+    };
+
+    struct reply_s {
+        int fd;
+        int result;
+        int len;
+        uint8_t data[DS2431_MEMORY_SIZE];
+    };
+
+    enum event_type_t {
+        EVENT_FOUND,
+        EVENT_REMOVED,
+        EVENT_READING,
+        // result holds the new W1INVENTORY_FLAG_* or memory hash of the device
+        EVENT_FLAGS,
+        EVENT_MEMORY_HASH,
+        // result is the number of devices that did not fit into shm
+        EVENT_SHM_FULL,
+        // the EVENT_FOUND between these two are the complete device list,
+        // sent after device events were dropped
+        EVENT_RESYNC_START,
+        EVENT_RESYNC_END
+    };
+
+    struct event_s {
+        event_type_t type;
+        uint64_t rom;
+        int result;
+        int len;
+        uint8_t data[W1SHM_READING_SIZE];
+    };
+
+    int scanJob(DS2482 &ds);
+    void updateDevices(const uint64_t *found, int count);
+    /*!
+     * \brief flushResync - queues as much of a pending device list resync as
+     * fits into the event queue, the rest follows on the next call
+     */
+    void flushResync();
+    int readingJob(DS2482 &ds);
+    /*!
+     * \brief readDevice - reads DS2431 memory at the level chosen by the
+     * tuner, failed reads are retried W1DAEMON_READ_RETRIES times
+     * \param report - reports the outcome and retries to the tuner
+     * \return 0 on success, -1 on failure
+     */
+    int readDevice(DS2482 &ds, uint64_t rom, int address, uint8_t *buf, int len, bool report);
+    void recordDevice(uint64_t rom, const uint8_t *buf, int len);
+    int commandJob(DS2482 &ds);
+    /*!
+     * \return false if the event was dropped because the queue is full
+     */
+    bool queueEvent(event_type_t type, uint64_t rom, int result = 0,
+                    const uint8_t *data = nullptr, int len = 0);
+    void wakeSocketThread();
+
+    void acceptClient();
+    int handleClient(int fd);
+    int handleCommand(int fd, const QByteArray &line);
+    void closeClient(int fd);
+    void handleBusEvents();
+    void handleDeviceEvent(const event_s &event);
+    void syncInventory();
+
+    static void reply(int fd, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+    DS2482 &ds;
+    W1Scheduler scheduler;
+    W1ShmWriter shm;
+    W1ShmReader shmReader;
+
+    int scanIntervalMs = 1000;
+    int readingPeriodMs = 5000;
+    int rtPriority = 0;
+    int rtCpu = -1;
+
+    W1TelemetryWriter *telemetry = nullptr;
+
+    W1Inventory *inventory = nullptr;
+    QString inventoryFile;
+    QString inventoryBus;
+
+    // socket thread only
+    QString socketPath;
+    int listenFd = -1;
+    QHash<int, QByteArray> clients;
+    bool quitRequested = false;
+    int pendingCommands = 0;
+    uint32_t reportedDrops = 0;
+    bool inventoryDirty = false;
+    // devices on the bus as told by the device events, the shm list is capped
+    // at W1SHM_MAX_DEVICES
+    QList<uint64_t> presentDevices;
+    QList<uint64_t> resyncDevices;
+    bool resyncing = false;
+    bool devicesChanged = false;
+
+    // shared between the socket thread and the bus thread
+    int wakeFd = -1;
+    W1SpscQueue<command_s, W1DAEMON_COMMAND_QUEUE> commands;
+    // one slot per command, replies are never dropped
+    W1SpscQueue<reply_s, W1DAEMON_COMMAND_QUEUE> replies;
+    W1SpscQueue<event_s, W1DAEMON_EVENT_QUEUE> events;
+    std::atomic<uint32_t> droppedEvents { 0 };
+    std::atomic<bool> scanRequested;
+    std::atomic<bool> busStop { false };
+
+    // bus thread only, preallocated
+    uint64_t devices[W1DAEMON_MAX_DEVICES];
+    int deviceCount = 0;
+    uint64_t known[W1DAEMON_MAX_DEVICES];
+    int knownCount = 0;
+    uint64_t added[W1DAEMON_MAX_DEVICES];
+    uint64_t removed[W1DAEMON_MAX_DEVICES];
+    // next step of a device list resync: -1 none, 0 start, i + 1 devices[i],
+    // deviceCount + 1 end
+    int resyncNext = -1;
+    W1RomRegistry registry;
+    W1LinkTuner tuner;
+    // scans are due every scanIntervalMs, whether or not they fit a gap
+    int64_t nextScanUs = 0;
+    // devices come from the inventory and were not confirmed by a search yet
+    bool warmStart = false;
+};
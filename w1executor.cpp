@@ -0,0 +1,146 @@
+#include "w1executor.h"
+
+#include "w1clock.h"
+
+//------------------------------------------------------------------------------
+// W1AsyncLock
+//------------------------------------------------------------------------------
+W1AsyncLock::W1AsyncLock(W1Executor &_executor)
+    : executor(_executor)
+{
+
+}
+
+bool W1AsyncLock::acquire_awaiter::await_ready()
+{
+    if (!lock.locked)
+    {
+        lock.locked = true;
+        return true;
+    }
+
+    return false;
+}
+
+void W1AsyncLock::acquire_awaiter::await_suspend(std::coroutine_handle<> handle)
+{
+    lock.waiters.push_back(handle);
+}
+
+void W1AsyncLock::unlock()
+{
+    if (waiters.empty())
+    {
+        locked = false;
+        return;
+    }
+
+    // hand over directly, locked stays set
+    std::coroutine_handle<> next = waiters.front();
+    waiters.pop_front();
+    executor.schedule(next);
+}
+
+//------------------------------------------------------------------------------
+// W1Executor
+//------------------------------------------------------------------------------
+W1Executor::W1Executor()
+{
+
+}
+
+W1Executor::~W1Executor()
+{
+    // unfinished tasks are destroyed with their frames
+}
+
+void W1Executor::spawn(W1Task<void> task)
+{
+    if (!task.valid())
+    {
+        return;
+    }
+
+    schedule(task.coroutine());
+    roots.push_back(std::move(task));
+}
+
+void W1Executor::schedule(std::coroutine_handle<> handle)
+{
+    ready.push_back(handle);
+}
+
+void W1Executor::scheduleAt(int64_t timeUs, std::coroutine_handle<> handle)
+{
+    timers.push(timer_s { timeUs, timerSequence++, handle });
+}
+
+W1Executor::sleep_awaiter W1Executor::sleep(int64_t us)
+{
+    return sleep_awaiter { *this, w1_now_us() + us };
+}
+
+void W1Executor::sweep()
+{
+    for (size_t i = 0; i < roots.size(); )
+    {
+        if (roots[i].done())
+        {
+            roots.erase(roots.begin() + i);
+        } else {
+            i++;
+        }
+    }
+}
+
+int W1Executor::run(const std::atomic<bool> *stop)
+{
+    startedUs = w1_now_us();
+
+    while (!roots.empty() && (stop == nullptr || !*stop))
+    {
+        int64_t now = w1_now_us();
+        while (!timers.empty() && timers.top().wakeUs <= now)
+        {
+            ready.push_back(timers.top().handle);
+            timers.pop();
+        }
+
+        if (ready.empty())
+        {
+            if (timers.empty())
+            {
+                // everybody waits for a lock nobody will release
+                fprintf(stderr, "%d tasks can not continue\n", (int) roots.size());
+                return -1;
+            }
+
+            int64_t wakeUs = timers.top().wakeUs;
+            w1_sleep_until_us(wakeUs);
+            idleTime += w1_now_us() - now;
+            continue;
+        }
+
+        // handles scheduled while this batch runs wait for the next round
+        size_t count = ready.size();
+        for (size_t i = 0; i < count; i++)
+        {
+            std::coroutine_handle<> handle = ready.front();
+            ready.pop_front();
+            handle.resume();
+            resumeCount++;
+        }
+
+        sweep();
+    }
+
+    return 0;
+}
+
+void W1Executor::printReport(FILE *f) const
+{
+    int64_t elapsed = w1_now_us() - startedUs;
+    fprintf(f, "executor: %llu resumes, %lld ms run, %lld ms idle, %d tasks left\n",
+            (unsigned long long) resumeCount, (long long) elapsed / 1000,
+            (long long) idleTime / 1000, (int) roots.size());
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <coroutine>
+#include <deque>
+#include <queue>
+#include <vector>
+
+#include "w1task.h"
+
+class W1Executor;
+
+/*!
+ * \class W1AsyncLock
+ *
+ * \brief Coroutine mutex, waiters are queued in arrival order and the lock
+ * is handed over directly to the first one, like DS2482Bus
+ *
+ *   W1AsyncLock::Guard guard = co_await lock.acquire();
+ */
+class W1AsyncLock
+{
+public:
+    W1AsyncLock(W1Executor &executor);
+
+    class Guard
+    {
+    public:
+        Guard(W1AsyncLock *_lock = nullptr) : lock(_lock) {}
+        Guard(Guard &&other) : lock(other.lock) { other.lock = nullptr; }
+        ~Guard() { release(); }
+
+        Guard(const Guard &) = delete;
+        Guard &operator=(const Guard &) = delete;
+
+        void release()
+        {
+            if (lock != nullptr)
+            {
+                lock->unlock();
+                lock = nullptr;
+            }
+        }
+
+    private:
+        W1AsyncLock *lock;
+    };
+
+    struct acquire_awaiter {
+        W1AsyncLock &lock;
+
+        bool await_ready();
+        void await_suspend(std::coroutine_handle<> handle);
+        Guard await_resume() { return Guard(&lock); }
+    };
+
+    acquire_awaiter acquire() { return acquire_awaiter { *this }; }
+    void unlock();
+
+private:
+    W1Executor &executor;
+    bool locked = false;
+    std::deque<std::coroutine_handle<> > waiters;
+};
+
+/*!
+ * \class W1Executor
+ *
+ * \brief Single threaded executor for W1Task coroutines
+ *
+ * Spawned tasks run until they wait: for a bus operation to finish, for a
+ * strong pullup or conversion delay, or for a W1AsyncLock. Meanwhile the
+ * tasks of other bridges continue, so one thread keeps a transaction in
+ * flight on every bridge. When nothing is ready the thread sleeps until the
+ * earliest timer.
+ */
+class W1Executor
+{
+public:
+    struct sleep_awaiter {
+        W1Executor &executor;
+        int64_t wakeUs;
+
+        bool await_ready() { return false; }
+        void await_suspend(std::coroutine_handle<> handle) { executor.scheduleAt(wakeUs, handle); }
+        void await_resume() {}
+    };
+
+    W1Executor();
+    ~W1Executor();
+
+    /*!
+     * \brief spawn - takes ownership of a task and starts it from run()
+     */
+    void spawn(W1Task<void> task);
+
+    void schedule(std::coroutine_handle<> handle);
+    void scheduleAt(int64_t timeUs, std::coroutine_handle<> handle);
+
+    /*!
+     * \brief sleep - co_await executor.sleep(us) suspends for at least us
+     */
+    sleep_awaiter sleep(int64_t us);
+    // lets the other ready tasks run first
+    sleep_awaiter yield() { return sleep(0); }
+
+    /*!
+     * \brief run - runs until all spawned tasks are done or *stop becomes true
+     * \return 0 on success, -1 if tasks are left that can never be resumed
+     */
+    int run(const std::atomic<bool> *stop = nullptr);
+
+    int tasks() const { return (int) roots.size(); }
+    uint64_t resumes() const { return resumeCount; }
+    uint64_t idleUs() const { return idleTime; }
+
+    void printReport(FILE *f) const;
+
+private:
+    struct timer_s {
+        int64_t wakeUs;
+        uint64_t sequence;
+        std::coroutine_handle<> handle;
+
+        // priority_queue keeps the largest on top, so compare reversed
+        bool operator<(const timer_s &other) const
+        {
+            return wakeUs != other.wakeUs ? wakeUs > other.wakeUs : sequence > other.sequence;
+        }
+    };
+
+    void sweep();
+
+    std::vector<W1Task<void> > roots;
+    std::deque<std::coroutine_handle<> > ready;
+    std::priority_queue<timer_s> timers;
+    uint64_t timerSequence = 0;
+
+    uint64_t resumeCount = 0;
+    uint64_t idleTime = 0;
+    int64_t startedUs = 0;
+};
@@ -0,0 +1,198 @@
+#include "w1inventory.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+W1Inventory::W1Inventory()
+{
+
+}
+
+QString W1Inventory::busKey(QString deviceFile, uint8_t address, int channel)
+{
+    return QString("%1:%2:%3").arg(deviceFile).arg(address, 2, 16, QChar('0')).arg(channel);
+}
+
+int W1Inventory::load(QString fileName)
+{
+    buses.clear();
+
+    FILE *f = fopen(fileName.toLocal8Bit().constData(), "r");
+    if (f == NULL)
+    {
+        if (errno == ENOENT)
+        {
+            return 0;
+        }
+        fprintf(stderr, "Could not open inventory: %m\n");
+        return -1;
+    }
+
+    char line[512];
+    int lineNumber = 0;
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        lineNumber++;
+        if (line[0] == '#' || line[0] == '\n')
+        {
+            continue;
+        }
+
+        char bus[256];
+        unsigned long long rom;
+        unsigned int flags, hash;
+        if (sscanf(line, "%255s %llx %x %x", bus, &rom, &flags, &hash) != 4
+                || !W1Bridge::w1_check_rom_crc(rom))
+        {
+            fprintf(stderr, "Skipping invalid inventory line %d\n", lineNumber);
+            continue;
+        }
+
+        w1inventory_entry_t entry;
+        entry.rom = rom;
+        entry.flags = flags;
+        entry.memoryHash = hash;
+        buses[QString(bus)] << entry;
+    }
+    fclose(f);
+
+    return 0;
+}
+
+int W1Inventory::save(QString fileName) const
+{
+    QByteArray tmpName = (fileName + ".tmp").toLocal8Bit();
+    FILE *f = fopen(tmpName.constData(), "w");
+    if (f == NULL)
+    {
+        fprintf(stderr, "Could not write inventory: %m\n");
+        return -1;
+    }
+
+    fprintf(f, "%s\n", W1INVENTORY_HEADER);
+    foreach (const QString &bus, buses.keys())
+    {
+        foreach (const w1inventory_entry_t &entry, buses[bus])
+        {
+            fprintf(f, "%s %016llx %02x %08x\n", bus.toLocal8Bit().constData(),
+                    (unsigned long long) entry.rom, entry.flags, entry.memoryHash);
+        }
+    }
+
+    if (fflush(f) != 0 || fsync(fileno(f)) != 0)
+    {
+        fprintf(stderr, "Could not write inventory: %m\n");
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+
+    if (rename(tmpName.constData(), fileName.toLocal8Bit().constData()) != 0)
+    {
+        fprintf(stderr, "Could not replace inventory: %m\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+QList<w1inventory_entry_t> W1Inventory::entries(QString bus) const
+{
+    return buses.value(bus);
+}
+
+QList<uint64_t> W1Inventory::devices(QString bus) const
+{
+    QList<uint64_t> result;
+    foreach (const w1inventory_entry_t &entry, buses.value(bus))
+    {
+        result << entry.rom;
+    }
+    return result;
+}
+
+bool W1Inventory::setDevices(QString bus, const QList<uint64_t> &devices, uint8_t flags)
+{
+    const QList<w1inventory_entry_t> old = buses.value(bus);
+    QList<w1inventory_entry_t> result;
+    bool changed = old.count() != devices.count();
+
+    foreach (uint64_t rom, devices)
+    {
+        w1inventory_entry_t entry;
+        entry.rom = rom;
+        entry.flags = flags;
+        entry.memoryHash = 0;
+
+        bool found = false;
+        foreach (const w1inventory_entry_t &prev, old)
+        {
+            if (prev.rom == rom)
+            {
+                entry.flags |= prev.flags;
+                entry.memoryHash = prev.memoryHash;
+                changed = changed || entry.flags != prev.flags;
+                found = true;
+                break;
+            }
+        }
+        changed = changed || !found;
+
+        result << entry;
+    }
+
+    buses[bus] = result;
+
+    return changed;
+}
+
+bool W1Inventory::setFlags(QString bus, uint64_t rom, uint8_t flags)
+{
+    if (!buses.contains(bus))
+    {
+        return false;
+    }
+
+    QList<w1inventory_entry_t> &list = buses[bus];
+    for (int i = 0; i < list.count(); i++)
+    {
+        if (list[i].rom == rom && list[i].flags != flags)
+        {
+            list[i].flags = flags;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool W1Inventory::setMemoryHash(QString bus, uint64_t rom, uint32_t hash)
+{
+    if (!buses.contains(bus))
+    {
+        return false;
+    }
+
+    QList<w1inventory_entry_t> &list = buses[bus];
+    for (int i = 0; i < list.count(); i++)
+    {
+        if (list[i].rom == rom && list[i].memoryHash != hash)
+        {
+            list[i].memoryHash = hash;
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t W1Inventory::hashMemory(const uint8_t *buf, int len)
+{
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < len; i++)
+    {
+        hash ^= buf[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <QHash>
+#include <QList>
+#include <QString>
+
+#include <stdint.h>
+
+#include "w1bridge.h"
+
+#define W1INVENTORY_HEADER "# OneWire inventory v1"
+
+#define W1INVENTORY_FLAG_OVERDRIVE 1
+
+struct w1inventory_entry_t {
+    uint64_t rom;
+    uint8_t flags;
+    uint32_t memoryHash;
+};
+
+/*!
+ * \class W1Inventory
+ *
+ * \brief Last known devices per bus, persisted between runs
+ *
+ * A bus is identified by a key built from the i2c device, the DS2482 address
+ * and the 1-wire channel (see busKey()). After a restart the known devices
+ * can be served right away; a full search running later in the background
+ * confirms them.
+ *
+ * The flags record what a device was seen to support (W1INVENTORY_FLAG_*),
+ * the memory hash is the hashMemory() of the last memory read from it.
+ *
+ * The file is a text file, one device per line:
+ *   <bus> <rom> <flags> <memory hash>
+ */
+class W1Inventory
+{
+public:
+    W1Inventory();
+
+    /*!
+     * \brief load - reads an inventory file, a missing file is an empty inventory
+     * \return 0 on success, -1 on failure
+     */
+    int load(QString fileName);
+    /*!
+     * \brief save - writes the inventory, the file is replaced atomically
+     * \return 0 on success, -1 on failure
+     */
+    int save(QString fileName) const;
+
+    static QString busKey(QString deviceFile, uint8_t address, int channel);
+
+    QList<w1inventory_entry_t> entries(QString bus) const;
+    QList<uint64_t> devices(QString bus) const;
+
+    /*!
+     * \brief setDevices - replaces the device list of a bus, metadata of
+     * devices that are still present is kept
+     * \return true if the list changed
+     */
+    bool setDevices(QString bus, const QList<uint64_t> &devices, uint8_t flags = 0);
+    /*!
+     * \return true if a known device changed
+     */
+    bool setFlags(QString bus, uint64_t rom, uint8_t flags);
+    bool setMemoryHash(QString bus, uint64_t rom, uint32_t hash);
+
+    /*!
+     * \brief hashMemory - FNV-1a hash of a memory image
+     */
+    static uint32_t hashMemory(const uint8_t *buf, int len);
+
+private:
+    QHash<QString, QList<w1inventory_entry_t> > buses;
+};
@@ -0,0 +1,326 @@
+#include "w1linktuner.h"
+
+#include <string.h>
+
+#include "w1clock.h"
+
+#define W1LINK_RATE_ONE (1 << 16)
+
+// fastest first
+static const w1link_mode_t linkModes[] = {
+    { true,  true,  "overdrive" },
+    { false, true,  "standard" },
+    { false, false, "passive" }
+};
+
+#define W1LINK_LEVELS ((int) (sizeof(linkModes) / sizeof(linkModes[0])))
+
+static inline uint32_t linkHash(uint64_t rom)
+{
+    // the family code is in the low byte, spread all bits with a multiply
+    return (rom * 0x9E3779B97F4A7C15ULL) >> 32;
+}
+
+W1LinkTuner::link_s::link_s()
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+W1LinkTuner::W1LinkTuner(int capacity)
+    : deviceCapacity(capacity > 0 ? capacity : 0),
+      probeIntervalUs((int64_t) W1LINK_PROBE_INTERVAL_MS * 1000)
+{
+    bus.backoffUs = probeIntervalUs;
+
+    int size = 16;
+    while (size < deviceCapacity * 2)
+    {
+        size <<= 1;
+    }
+    devices.fill(link_s(), size);
+}
+
+int W1LinkTuner::levelCount()
+{
+    return W1LINK_LEVELS;
+}
+
+const w1link_mode_t &W1LinkTuner::levelMode(int level)
+{
+    return linkModes[level];
+}
+
+void W1LinkTuner::setProbeInterval(int ms)
+{
+    probeIntervalUs = (int64_t) ms * 1000;
+    bus.backoffUs = probeIntervalUs;
+}
+
+int W1LinkTuner::findLink(uint64_t rom) const
+{
+    if (rom == 0)
+    {
+        return -1;
+    }
+
+    int mask = devices.count() - 1;
+    for (int i = linkHash(rom) & mask; devices[i].rom != 0; i = (i + 1) & mask)
+    {
+        if (devices[i].rom == rom)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+int W1LinkTuner::level(uint64_t rom) const
+{
+    int slot = findLink(rom);
+    if (slot < 0)
+    {
+        return bus.level;
+    }
+
+    int device = devices[slot].level;
+    return device > bus.level ? device : bus.level;
+}
+
+const w1link_mode_t &W1LinkTuner::mode(uint64_t rom) const
+{
+    return linkModes[level(rom)];
+}
+
+W1LinkTuner::link_stats_t W1LinkTuner::stats(uint64_t rom) const
+{
+    int slot = findLink(rom);
+    const link_s &link = slot < 0 ? bus : devices[slot];
+    link_stats_t result = link.stats;
+    result.level = link.level;
+    result.errorRate = (double) link.errorRate / W1LINK_RATE_ONE;
+
+    return result;
+}
+
+void W1LinkTuner::forget(uint64_t rom)
+{
+    int slot = findLink(rom);
+    if (slot < 0)
+    {
+        return;
+    }
+
+    // backward shift deletion, later entries of the probe run move up so
+    // lookups never need tombstones
+    int mask = devices.count() - 1;
+    int hole = slot;
+    for (int i = (slot + 1) & mask; devices[i].rom != 0; i = (i + 1) & mask)
+    {
+        int home = linkHash(devices[i].rom) & mask;
+        if (((i - home) & mask) >= ((i - hole) & mask))
+        {
+            devices[hole] = devices[i];
+            hole = i;
+        }
+    }
+    devices[hole] = link_s();
+    deviceCount--;
+}
+
+//------------------------------------------------------------------------------
+// Bridge setup
+//------------------------------------------------------------------------------
+int W1LinkTuner::applyPullup(W1Bridge &ds, const w1link_mode_t &m)
+{
+    // writing the config costs a bus transaction on some bridges
+    if (appliedPullup == (int) m.activePullup)
+    {
+        return 0;
+    }
+
+    if (ds.set_active_pullup(m.activePullup) != 0)
+    {
+        appliedPullup = -1;
+        return -1;
+    }
+    appliedPullup = m.activePullup;
+
+    return 0;
+}
+
+int W1LinkTuner::prepareSearch(W1Bridge &ds)
+{
+    const w1link_mode_t &m = linkModes[bus.level];
+    if (applyPullup(ds, m) != 0 || ds.set_high_speed(false) != 0)
+    {
+        return -1;
+    }
+
+    if (!m.overdrive)
+    {
+        return 0;
+    }
+
+    if (ds.w1_overdrive_skip_rom() != 0)
+    {
+        ds.w1_log("Could not switch bus to overdrive\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+int W1LinkTuner::select(W1Bridge &ds, uint64_t rom)
+{
+    const w1link_mode_t &m = mode(rom);
+    if (applyPullup(ds, m) != 0 || ds.set_high_speed(false) != 0)
+    {
+        return -1;
+    }
+
+    // a standard speed reset returns every device to standard speed
+    return m.overdrive ? ds.w1_overdrive_match_rom(rom) : ds.w1_match_rom(rom);
+}
+
+//------------------------------------------------------------------------------
+// Error tracking
+//------------------------------------------------------------------------------
+void W1LinkTuner::report(uint64_t rom, bool ok, int retries)
+{
+    int64_t now = w1_now_us();
+
+    if (rom == 0)
+    {
+        update(bus, ok, retries, now);
+        return;
+    }
+
+    int slot = findLink(rom);
+    if (slot < 0)
+    {
+        if (deviceCount >= deviceCapacity)
+        {
+            return;
+        }
+
+        int mask = devices.count() - 1;
+        slot = linkHash(rom) & mask;
+        while (devices[slot].rom != 0)
+        {
+            slot = (slot + 1) & mask;
+        }
+
+        devices[slot] = link_s();
+        devices[slot].rom = rom;
+        devices[slot].backoffUs = probeIntervalUs;
+        devices[slot].nextProbeUs = now + probeIntervalUs;
+        deviceCount++;
+    }
+
+    update(devices[slot], ok, retries, now);
+}
+
+void W1LinkTuner::update(link_s &link, bool ok, int retries, int64_t now)
+{
+    link.stats.attempts++;
+    link.stats.retries += retries;
+    if (!ok)
+    {
+        link.stats.failures++;
+    }
+
+    // exponentially weighted error rate, every retry was a failed try
+    for (int i = 0; i <= retries; i++)
+    {
+        bool failed = i < retries || !ok;
+        link.errorRate -= link.errorRate >> W1LINK_RATE_SHIFT;
+        if (failed)
+        {
+            link.errorRate += W1LINK_RATE_ONE >> W1LINK_RATE_SHIFT;
+            link.failures++;
+        }
+        link.samples++;
+    }
+
+    double rate = (double) link.errorRate / W1LINK_RATE_ONE;
+
+    if (link.samples >= W1LINK_MIN_SAMPLES && link.failures >= W1LINK_MIN_FAILURES
+            && rate > W1LINK_STEP_DOWN_RATE)
+    {
+        if (link.probing)
+        {
+            // the faster mode did not hold, wait longer before the next try
+            link.level = link.safeLevel;
+            link.backoffUs *= 2;
+            if (link.backoffUs > (int64_t) W1LINK_MAX_BACKOFF_MS * 1000)
+            {
+                link.backoffUs = (int64_t) W1LINK_MAX_BACKOFF_MS * 1000;
+            }
+        } else {
+            if (link.level < W1LINK_LEVELS - 1)
+            {
+                link.level++;
+                link.stats.stepDowns++;
+            }
+            link.backoffUs = probeIntervalUs;
+        }
+
+        link.probing = false;
+        link.samples = 0;
+        link.failures = 0;
+        link.errorRate = 0;
+        link.nextProbeUs = now + link.backoffUs;
+        return;
+    }
+
+    if (link.probing)
+    {
+        if (link.samples >= W1LINK_PROBE_SAMPLES)
+        {
+            link.probing = false;
+            link.backoffUs = probeIntervalUs;
+            link.nextProbeUs = now + link.backoffUs;
+        }
+        return;
+    }
+
+    if (link.level > 0 && now >= link.nextProbeUs
+            && link.samples >= W1LINK_MIN_SAMPLES && rate < W1LINK_PROBE_RATE)
+    {
+        link.safeLevel = link.level;
+        link.level--;
+        link.probing = true;
+        link.samples = 0;
+        link.failures = 0;
+        link.errorRate = 0;
+        link.stats.probes++;
+    }
+}
+
+void W1LinkTuner::printReport(FILE *f) const
+{
+    fprintf(f, "%-16s %-13s %10s %8s %8s %6s %6s %7s\n", "link", "mode", "attempts", "failed",
+            "retries", "down", "probes", "rate");
+
+    link_stats_t s = stats(0);
+    fprintf(f, "%-16s %-13s %10llu %8llu %8llu %6u %6u %6.2f%%\n", "bus",
+            linkModes[bus.level].name, (unsigned long long) s.attempts,
+            (unsigned long long) s.failures, (unsigned long long) s.retries, s.stepDowns,
+            s.probes, s.errorRate * 100);
+
+    foreach (const link_s &link, devices)
+    {
+        if (link.rom == 0)
+        {
+            continue;
+        }
+
+        uint64_t rom = link.rom;
+        s = stats(rom);
+        fprintf(f, "%016llx %-13s %10llu %8llu %8llu %6u %6u %6.2f%%\n",
+                (unsigned long long) rom, mode(rom).name, (unsigned long long) s.attempts,
+                (unsigned long long) s.failures, (unsigned long long) s.retries, s.stepDowns,
+                s.probes, s.errorRate * 100);
+    }
+}
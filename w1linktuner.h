@@ -0,0 +1,134 @@
+#pragma once
+
+#include <QVector>
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "w1bridge.h"
+
+// error rate above which a link steps down, and below which it may probe up
+#define W1LINK_STEP_DOWN_RATE   0.05
+#define W1LINK_PROBE_RATE       0.01
+// weight of a new result in the error rate (1/64), one failure alone stays
+// below W1LINK_STEP_DOWN_RATE
+#define W1LINK_RATE_SHIFT       6
+// results needed before a decision, and to accept a probe
+#define W1LINK_MIN_SAMPLES      16
+// failures since the last decision needed to step down
+#define W1LINK_MIN_FAILURES     3
+#define W1LINK_PROBE_SAMPLES    32
+#define W1LINK_PROBE_INTERVAL_MS 60000
+#define W1LINK_MAX_BACKOFF_MS   (3600 * 1000)
+#define W1LINK_DEFAULT_DEVICES  1024
+
+/*!
+ * \brief bus settings of one tuning level
+ */
+struct w1link_mode_t {
+    bool overdrive;
+    bool activePullup;
+    const char *name;
+};
+
+/*!
+ * \class W1LinkTuner
+ *
+ * \brief Picks bus speed and pullup mode from the measured error rate
+ *
+ * The levels run from the fastest mode (overdrive, active pullup) down to
+ * standard speed with passive pullup. Strong pullup is not a level; it is
+ * chosen per powered operation (see W1Sequence::execute()). The bus and
+ * every device have their own level; a device runs at the slower of the
+ * two, so one device at the end of a long branch does not slow the rest.
+ *
+ * Callers report the outcome of every search or device transaction; every
+ * try counts in the error rate, retries included. When the error rate of a
+ * link passes W1LINK_STEP_DOWN_RATE with at least W1LINK_MIN_FAILURES
+ * failures it moves one level down. A link that has been clean for the
+ * probe interval tries one level up; a failed probe doubles the interval
+ * for that link.
+ *
+ * The device links live in a table that is allocated once for the given
+ * capacity, reports and forget() neither allocate nor print, so the tuner
+ * can run on a W1RealtimeThread. Devices beyond the capacity follow the bus.
+ */
+class W1LinkTuner
+{
+public:
+    W1LinkTuner(int capacity = W1LINK_DEFAULT_DEVICES);
+
+    struct link_stats_t {
+        int level;
+        uint64_t attempts;
+        uint64_t failures;
+        uint64_t retries;
+        uint32_t stepDowns;
+        uint32_t probes;
+        double errorRate;
+    };
+
+    static int levelCount();
+    static const w1link_mode_t &levelMode(int level);
+
+    void setProbeInterval(int ms);
+
+    /*!
+     * \brief prepareSearch - configures the bridge for a bus wide operation,
+     * in overdrive all devices are switched to overdrive first
+     * \return 0 on success, -1 on failure
+     */
+    int prepareSearch(W1Bridge &ds);
+    /*!
+     * \brief select - configures the bridge for the device and selects it
+     * with (overdrive) match ROM
+     * \return 0 on success, -1 on failure
+     */
+    int select(W1Bridge &ds, uint64_t rom);
+
+    /*!
+     * \brief report - records the outcome of an operation
+     * \param rom - device, 0 for bus wide operations like a search
+     * \param ok - false on CRC or bus errors
+     * \param retries - retries that were needed before the final outcome
+     */
+    void report(uint64_t rom, bool ok, int retries = 0);
+
+    const w1link_mode_t &mode(uint64_t rom = 0) const;
+    int level(uint64_t rom = 0) const;
+    link_stats_t stats(uint64_t rom = 0) const;
+    void forget(uint64_t rom);
+
+    void printReport(FILE *f) const;
+
+private:
+    struct link_s {
+        uint64_t rom = 0;       // 0 marks a free slot
+        int level = 0;
+        int safeLevel = 0;      // level to return to if a probe fails
+        bool probing = false;
+        int samples = 0;
+        int failures = 0;       // since the last decision
+        uint32_t errorRate = 0; // fixed point, 1 << 16 = 100 %
+        int64_t nextProbeUs = 0;
+        int64_t backoffUs = 0;
+        link_stats_t stats;
+
+        link_s();
+    };
+
+    /*!
+     * \return slot of the device, -1 if it is not tracked
+     */
+    int findLink(uint64_t rom) const;
+    void update(link_s &link, bool ok, int retries, int64_t now);
+    int applyPullup(W1Bridge &ds, const w1link_mode_t &m);
+
+    link_s bus;
+    // open addressing with linear probing, at most half full
+    QVector<link_s> devices;
+    int deviceCapacity;
+    int deviceCount = 0;
+    int64_t probeIntervalUs;
+    int appliedPullup = -1;
+};
@@ -0,0 +1,182 @@
+#include "w1piosampler.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "w1clock.h"
+
+W1PioSampler::W1PioSampler(int capacity)
+{
+    ring.resize(capacity > 0 ? capacity : 1);
+    memset(&statistics, 0, sizeof(statistics));
+}
+
+void W1PioSampler::setOverdrive(bool _overdrive)
+{
+    overdrive = _overdrive;
+}
+
+int W1PioSampler::start(W1Bridge &ds, uint64_t _rom)
+{
+    uint8_t family = _rom & 0xFF;
+    if (family != DS2408_FAMILY_CODE && family != DS2413_FAMILY_CODE)
+    {
+        fprintf(stderr, "%016llx is not a DS2408 or DS2413\n", (unsigned long long) _rom);
+        return W1PIO_BUS_ERROR;
+    }
+
+    rom = _rom;
+    active = false;
+    statistics.starts++;
+
+    // a standard speed reset also reaches devices left in overdrive
+    if (ds.set_high_speed(false) != 0)
+    {
+        return W1PIO_BUS_ERROR;
+    }
+
+    // MATCH ROM does not look at the presence pulse, an absent device would
+    // stream all ones that pass as valid DS2408 samples
+    if (ds.w1_reset() <= 0)
+    {
+        return W1PIO_BUS_ERROR;
+    }
+
+    int ret = overdrive ? ds.w1_overdrive_match_rom(rom) : ds.w1_match_rom(rom);
+    if (ret != 0 || ds.w1_write_byte(W1Bridge::PIO_CMD_ACCESS_READ) != 0)
+    {
+        return W1PIO_BUS_ERROR;
+    }
+
+    active = true;
+    firstPacket = true;
+
+    return W1PIO_OK;
+}
+
+void W1PioSampler::stop(W1Bridge &ds)
+{
+    if (active)
+    {
+        ds.w1_reset();
+        active = false;
+    }
+}
+
+int W1PioSampler::poll(W1Bridge &ds)
+{
+    if (!active && (rom == 0 || start(ds, rom) != W1PIO_OK))
+    {
+        return W1PIO_BUS_ERROR;
+    }
+
+    return (rom & 0xFF) == DS2408_FAMILY_CODE ? pollDS2408(ds) : pollDS2413(ds);
+}
+
+int W1PioSampler::pollDS2408(W1Bridge &ds)
+{
+    uint8_t buf[W1PIO_DS2408_PACKET + 2];
+
+    int64_t begin = w1_now_us();
+    if (ds.w1_read_block(buf, sizeof(buf)) != (int) sizeof(buf))
+    {
+        active = false;
+        return W1PIO_BUS_ERROR;
+    }
+    int64_t end = w1_now_us();
+
+    // the CRC of the first packet starts with the command byte
+    uint16_t crc;
+    if (firstPacket)
+    {
+        static const uint8_t cmd = W1Bridge::PIO_CMD_ACCESS_READ;
+        crc = ~W1Bridge::w1_update_data_crc(W1Bridge::w1_update_data_crc(0, &cmd, 1),
+                                            buf, W1PIO_DS2408_PACKET);
+    } else {
+        crc = W1Bridge::w1_compute_data_crc(buf, W1PIO_DS2408_PACKET);
+    }
+
+    if (crc != (buf[W1PIO_DS2408_PACKET] | (buf[W1PIO_DS2408_PACKET + 1] << 8)))
+    {
+        statistics.crcErrors++;
+        active = false;
+        return W1PIO_CRC_ERROR;
+    }
+    firstPacket = false;
+    statistics.packets++;
+
+    for (int i = 0; i < W1PIO_DS2408_PACKET; i++)
+    {
+        push(begin + (end - begin) * (i + 1) / (int) sizeof(buf), buf[i]);
+    }
+
+    return W1PIO_DS2408_PACKET;
+}
+
+int W1PioSampler::pollDS2413(W1Bridge &ds)
+{
+    uint8_t buf[W1PIO_DS2413_PACKET];
+
+    int64_t begin = w1_now_us();
+    if (ds.w1_read_block(buf, sizeof(buf)) != (int) sizeof(buf))
+    {
+        active = false;
+        return W1PIO_BUS_ERROR;
+    }
+    int64_t end = w1_now_us();
+
+    statistics.packets++;
+
+    int valid = 0;
+    for (int i = 0; i < W1PIO_DS2413_PACKET; i++)
+    {
+        // the high nibble is the complement of the state
+        if (((buf[i] >> 4) ^ buf[i] ^ 0x0F) & 0x0F)
+        {
+            statistics.crcErrors++;
+            continue;
+        }
+
+        push(begin + (end - begin) * (i + 1) / (int) sizeof(buf), buf[i] & 0x0F);
+        valid++;
+    }
+
+    if (valid == 0)
+    {
+        // nothing but garbage, most likely the device is gone
+        active = false;
+        return W1PIO_CRC_ERROR;
+    }
+
+    return valid;
+}
+
+void W1PioSampler::push(int64_t timeUs, uint8_t state)
+{
+    sample_t &sample = ring[head];
+    sample.timeUs = timeUs;
+    sample.state = state;
+
+    head = (head + 1) % ring.count();
+    if (count < ring.count())
+    {
+        count++;
+    } else {
+        statistics.overruns++;
+    }
+    statistics.samples++;
+}
+
+int W1PioSampler::read(sample_t *samples, int maxSamples)
+{
+    int n = count < maxSamples ? count : maxSamples;
+    int tail = (head - count + ring.count()) % ring.count();
+
+    for (int i = 0; i < n; i++)
+    {
+        samples[i] = ring[(tail + i) % ring.count()];
+    }
+    count -= n;
+
+    return n;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <QVector>
+
+#include <stdint.h>
+
+#include "w1bridge.h"
+
+#define W1PIO_OK              0
+#define W1PIO_BUS_ERROR      -1
+#define W1PIO_CRC_ERROR      -2
+
+// the DS2408 sends a CRC16 after every 32 samples
+#define W1PIO_DS2408_PACKET   32
+// samples read per poll from a DS2413, every one carries its complement
+#define W1PIO_DS2413_PACKET   32
+#define W1PIO_DEFAULT_CAPACITY 4096
+
+/*!
+ * \class W1PioSampler
+ *
+ * \brief Streams input samples from a DS2408 or DS2413
+ *
+ * The device is addressed once and then sends its PIO state for every byte
+ * the master reads, so a sample costs 8 time slots instead of a reset,
+ * MATCH ROM and command. DS2408 packets of 32 samples are checked with
+ * their CRC16 (the first one includes the command byte); DS2413 samples
+ * are checked against their complement nibble. A failed packet drops the
+ * stream, the next poll() addresses the device again.
+ *
+ * Samples are timestamped by spreading the read time of a packet over its
+ * bytes and kept in a ring buffer; when the reader falls behind the oldest
+ * samples are overwritten and counted as overruns.
+ */
+class W1PioSampler
+{
+public:
+    struct sample_t {
+        int64_t timeUs;
+        uint8_t state;      // DS2408 pins, DS2413 pin/latch nibble
+    };
+
+    struct stats_t {
+        uint64_t samples;
+        uint64_t packets;
+        uint32_t crcErrors;
+        uint32_t starts;
+        uint64_t overruns;
+    };
+
+    W1PioSampler(int capacity = W1PIO_DEFAULT_CAPACITY);
+
+    // address the device with OVERDRIVE MATCH ROM
+    void setOverdrive(bool overdrive);
+
+    /*!
+     * \brief start - selects the device and starts the access read stream
+     * \param rom - DS2408 or DS2413
+     * \return W1PIO_OK on success, W1PIO_BUS_ERROR on failure or when no
+     * device answers the reset
+     */
+    int start(W1Bridge &ds, uint64_t rom);
+    /*!
+     * \brief poll - reads one packet into the ring buffer, restarts the
+     * stream if the previous packet failed
+     * \return number of new samples, W1PIO_BUS_ERROR or W1PIO_CRC_ERROR
+     */
+    int poll(W1Bridge &ds);
+    /*!
+     * \brief stop - ends the stream with a reset
+     */
+    void stop(W1Bridge &ds);
+    bool streaming() const { return active; }
+
+    int available() const { return count; }
+    /*!
+     * \brief read - takes the oldest samples out of the ring buffer
+     * \return number of samples copied
+     */
+    int read(sample_t *samples, int maxSamples);
+
+    stats_t stats() const { return statistics; }
+
+private:
+    int pollDS2408(W1Bridge &ds);
+    int pollDS2413(W1Bridge &ds);
+    void push(int64_t timeUs, uint8_t state);
+
+    QVector<sample_t> ring;
+    int head = 0;
+    int count = 0;
+
+    uint64_t rom = 0;
+    bool overdrive = false;
+    bool active = false;
+    bool firstPacket = false;
+    stats_t statistics;
+};
@@ -0,0 +1,293 @@
+#include "w1romregistry.h"
+
+#include <string.h>
+
+// resize when live entries plus tombstones exceed 3/4 of the table
+#define W1ROMREGISTRY_LOAD_NUM 3
+#define W1ROMREGISTRY_LOAD_DEN 4
+
+static inline uint32_t romHash(uint64_t rom)
+{
+    // the family code is in the low byte, spread all bits with a multiply
+    return (rom * 0x9E3779B97F4A7C15ULL) >> 32;
+}
+
+W1RomRegistry::W1RomRegistry(int capacity)
+{
+    for (int i = 0; i < 256; i++)
+    {
+        familyHead[i] = W1ROMREGISTRY_NONE;
+    }
+    rehash(capacity);
+}
+
+void W1RomRegistry::clear()
+{
+    for (int i = 0; i < 256; i++)
+    {
+        familyHead[i] = W1ROMREGISTRY_NONE;
+    }
+    busHead.fill(W1ROMREGISTRY_NONE);
+    busSize.fill(0);
+
+    // keeps the table size, rehash() would re-insert every entry
+    slots.fill(slot_s());
+    used = 0;
+    tombstones = 0;
+}
+
+void W1RomRegistry::reserve(int count)
+{
+    if ((used + tombstones > count ? used + tombstones : count) * W1ROMREGISTRY_LOAD_DEN
+            > slots.count() * W1ROMREGISTRY_LOAD_NUM)
+    {
+        rehash(count);
+    }
+}
+
+void W1RomRegistry::rehash(int capacity)
+{
+    int size = 16;
+    while (size * W1ROMREGISTRY_LOAD_NUM < capacity * W1ROMREGISTRY_LOAD_DEN)
+    {
+        size <<= 1;
+    }
+
+    QVector<slot_s> old = slots;
+    slots.fill(slot_s(), size);
+    mask = size - 1;
+    used = 0;
+    tombstones = 0;
+
+    for (int i = 0; i < 256; i++)
+    {
+        familyHead[i] = W1ROMREGISTRY_NONE;
+    }
+    for (int i = 0; i < busHead.count(); i++)
+    {
+        busHead[i] = W1ROMREGISTRY_NONE;
+        busSize[i] = 0;
+    }
+
+    for (int i = 0; i < old.count(); i++)
+    {
+        const slot_s &s = old[i];
+        if (s.rom == 0 || s.deleted)
+        {
+            continue;
+        }
+
+        int slot = insert(s.rom, s.bus);
+        slots[slot].generation = s.generation;
+        memcpy(slots[slot].meta, s.meta, sizeof(s.meta));
+    }
+}
+
+int W1RomRegistry::probe(uint64_t rom) const
+{
+    // returns the slot holding rom, or the first free slot of its probe run
+    int free = W1ROMREGISTRY_NONE;
+    for (uint32_t i = romHash(rom) & mask;; i = (i + 1) & mask)
+    {
+        const slot_s &s = slots[i];
+        if (s.rom == 0)
+        {
+            return free != W1ROMREGISTRY_NONE ? free : (int) i;
+        }
+        if (s.deleted)
+        {
+            if (free == W1ROMREGISTRY_NONE)
+            {
+                free = i;
+            }
+            continue;
+        }
+        if (s.rom == rom)
+        {
+            return i;
+        }
+    }
+}
+
+int W1RomRegistry::find(uint64_t rom) const
+{
+    if (rom == 0)
+    {
+        return W1ROMREGISTRY_NONE;
+    }
+
+    for (uint32_t i = romHash(rom) & mask;; i = (i + 1) & mask)
+    {
+        const slot_s &s = slots[i];
+        if (s.rom == 0)
+        {
+            return W1ROMREGISTRY_NONE;
+        }
+        if (!s.deleted && s.rom == rom)
+        {
+            return i;
+        }
+    }
+}
+
+int W1RomRegistry::firstOnBus(uint16_t bus) const
+{
+    return bus < busHead.count() ? busHead[bus] : W1ROMREGISTRY_NONE;
+}
+
+int W1RomRegistry::busCount(uint16_t bus) const
+{
+    return bus < busSize.count() ? busSize[bus] : 0;
+}
+
+void W1RomRegistry::link(int slot)
+{
+    slot_s &s = slots[slot];
+    uint8_t family = s.rom & 0xFF;
+
+    s.prevFamily = W1ROMREGISTRY_NONE;
+    s.nextFamily = familyHead[family];
+    if (s.nextFamily != W1ROMREGISTRY_NONE)
+    {
+        slots[s.nextFamily].prevFamily = slot;
+    }
+    familyHead[family] = slot;
+
+    while (busHead.count() <= s.bus)
+    {
+        busHead.append(W1ROMREGISTRY_NONE);
+        busSize.append(0);
+    }
+    s.prevBus = W1ROMREGISTRY_NONE;
+    s.nextBus = busHead[s.bus];
+    if (s.nextBus != W1ROMREGISTRY_NONE)
+    {
+        slots[s.nextBus].prevBus = slot;
+    }
+    busHead[s.bus] = slot;
+    busSize[s.bus]++;
+}
+
+void W1RomRegistry::unlink(int slot)
+{
+    slot_s &s = slots[slot];
+
+    if (s.prevFamily != W1ROMREGISTRY_NONE)
+    {
+        slots[s.prevFamily].nextFamily = s.nextFamily;
+    } else {
+        familyHead[s.rom & 0xFF] = s.nextFamily;
+    }
+    if (s.nextFamily != W1ROMREGISTRY_NONE)
+    {
+        slots[s.nextFamily].prevFamily = s.prevFamily;
+    }
+
+    if (s.prevBus != W1ROMREGISTRY_NONE)
+    {
+        slots[s.prevBus].nextBus = s.nextBus;
+    } else {
+        busHead[s.bus] = s.nextBus;
+    }
+    if (s.nextBus != W1ROMREGISTRY_NONE)
+    {
+        slots[s.nextBus].prevBus = s.prevBus;
+    }
+    busSize[s.bus]--;
+}
+
+int W1RomRegistry::insert(uint64_t rom, uint16_t bus)
+{
+    if (rom == 0)
+    {
+        return W1ROMREGISTRY_NONE;
+    }
+
+    int slot = probe(rom);
+    slot_s &s = slots[slot];
+    if (s.rom == rom && !s.deleted)
+    {
+        if (s.bus != bus)
+        {
+            unlink(slot);
+            s.bus = bus;
+            link(slot);
+        }
+        return slot;
+    }
+
+    if ((used + tombstones + 1) * W1ROMREGISTRY_LOAD_DEN > slots.count() * W1ROMREGISTRY_LOAD_NUM)
+    {
+        // grow only if the live entries need it, otherwise just drop tombstones
+        rehash((used + 1) * 2);
+        slot = probe(rom);
+    }
+
+    slot_s &n = slots[slot];
+    if (n.deleted)
+    {
+        tombstones--;
+    }
+    memset(&n, 0, sizeof(n));
+    n.rom = rom;
+    n.bus = bus;
+    n.generation = generation;
+    link(slot);
+    used++;
+
+    return slot;
+}
+
+bool W1RomRegistry::remove(uint64_t rom)
+{
+    int slot = find(rom);
+    if (slot == W1ROMREGISTRY_NONE)
+    {
+        return false;
+    }
+
+    unlink(slot);
+    slots[slot].deleted = true;
+    used--;
+    tombstones++;
+
+    return true;
+}
+
+void W1RomRegistry::reconcile(uint16_t bus, const uint64_t *found, int count,
+                              uint64_t *added, int *addedCount,
+                              uint64_t *removed, int *removedCount)
+{
+    generation++;
+    *addedCount = 0;
+    *removedCount = 0;
+
+    reserve(used + count);
+
+    for (int i = 0; i < count; i++)
+    {
+        int slot = find(found[i]);
+        if (slot == W1ROMREGISTRY_NONE || slots[slot].bus != bus)
+        {
+            slot = insert(found[i], bus);
+            if (slot == W1ROMREGISTRY_NONE)
+            {
+                continue;
+            }
+            added[(*addedCount)++] = found[i];
+        }
+        slots[slot].generation = generation;
+    }
+
+    int slot = firstOnBus(bus);
+    while (slot != W1ROMREGISTRY_NONE)
+    {
+        int next = slots[slot].nextBus;
+        if (slots[slot].generation != generation)
+        {
+            removed[(*removedCount)++] = slots[slot].rom;
+            remove(slots[slot].rom);
+        }
+        slot = next;
+    }
+}
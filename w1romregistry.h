@@ -0,0 +1,107 @@
+#pragma once
+
+#include <QVector>
+
+#include <stdint.h>
+
+#define W1ROMREGISTRY_META_SLOTS 4
+#define W1ROMREGISTRY_NONE       -1
+
+/*!
+ * \class W1RomRegistry
+ *
+ * \brief Flat hash table of known devices with family and bus indexes
+ *
+ * Devices are stored in an open addressing table (linear probing, keyed by
+ * the 64 bit id, 0 is not a valid key). Every entry is linked into a list
+ * per family code and a list per bus, and carries a few metadata words for
+ * the caller. Slot numbers stay valid until the entry is removed or the
+ * table is resized (see reserve()).
+ *
+ * reconcile() compares the result of a scan with the known devices of a
+ * bus in place; it does not allocate unless the table has to grow.
+ */
+class W1RomRegistry
+{
+public:
+    W1RomRegistry(int capacity = 64);
+
+    /*!
+     * \brief reserve - grows the table so that count devices fit without
+     * another resize
+     */
+    void reserve(int count);
+    void clear();
+
+    int count() const { return used; }
+    int busCount(uint16_t bus) const;
+
+    /*!
+     * \brief insert - adds a device or moves it to another bus
+     * \return slot of the device
+     */
+    int insert(uint64_t rom, uint16_t bus);
+    /*!
+     * \return slot of the device, W1ROMREGISTRY_NONE if unknown
+     */
+    int find(uint64_t rom) const;
+    bool contains(uint64_t rom) const { return find(rom) != W1ROMREGISTRY_NONE; }
+    /*!
+     * \return true if the device was known
+     */
+    bool remove(uint64_t rom);
+
+    uint64_t rom(int slot) const { return slots[slot].rom; }
+    uint16_t bus(int slot) const { return slots[slot].bus; }
+    uint64_t &meta(int slot, int index) { return slots[slot].meta[index]; }
+    uint64_t meta(int slot, int index) const { return slots[slot].meta[index]; }
+
+    // iteration over the secondary indexes, W1ROMREGISTRY_NONE ends the list
+    int firstInFamily(uint8_t family) const { return familyHead[family]; }
+    int nextInFamily(int slot) const { return slots[slot].nextFamily; }
+    int firstOnBus(uint16_t bus) const;
+    int nextOnBus(int slot) const { return slots[slot].nextBus; }
+
+    /*!
+     * \brief reconcile - updates the devices of a bus to the result of a scan
+     * \param bus - bus that was scanned
+     * \param found - devices found by the scan
+     * \param count - number of found devices
+     * \param added - receives new devices, needs room for count entries
+     * \param addedCount - number of new devices
+     * \param removed - receives devices that disappeared, needs room for
+     * busCount(bus) entries (before the call)
+     * \param removedCount - number of removed devices
+     */
+    void reconcile(uint16_t bus, const uint64_t *found, int count,
+                   uint64_t *added, int *addedCount,
+                   uint64_t *removed, int *removedCount);
+
+private:
+    struct slot_s {
+        uint64_t rom;       // 0 = empty
+        bool deleted;
+        uint16_t bus;
+        uint32_t generation;
+        int32_t nextFamily;
+        int32_t prevFamily;
+        int32_t nextBus;
+        int32_t prevBus;
+        uint64_t meta[W1ROMREGISTRY_META_SLOTS];
+    };
+
+    int probe(uint64_t rom) const;
+    void link(int slot);
+    void unlink(int slot);
+    void rehash(int capacity);
+
+    QVector<slot_s> slots;
+    int mask = 0;
+    int used = 0;
+    int tombstones = 0;
+    uint32_t generation = 0;
+
+    int32_t familyHead[256];
+    QVector<int32_t> busHead;
+    QVector<int32_t> busSize;
+};
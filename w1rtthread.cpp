@@ -0,0 +1,262 @@
+#include "w1rtthread.h"
+
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#define NSEC_PER_SEC 1000000000LL
+
+static int64_t timespec_ns(const struct timespec &ts)
+{
+    return (int64_t) ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+//------------------------------------------------------------------------------
+// Histogram
+//------------------------------------------------------------------------------
+void W1RealtimeThread::histogram_s::add(uint32_t us)
+{
+    int bucket;
+    if (us < W1RT_HISTOGRAM_FINE)
+    {
+        bucket = us;
+    } else if (us < W1RT_HISTOGRAM_FINE * (W1RT_HISTOGRAM_COARSE + 1)) {
+        bucket = W1RT_HISTOGRAM_FINE + us / 1000 - 1;
+    } else {
+        bucket = W1RT_HISTOGRAM_FINE + W1RT_HISTOGRAM_COARSE;
+    }
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+
+    uint32_t max = maxUs.load(std::memory_order_relaxed);
+    while (us > max && !maxUs.compare_exchange_weak(max, us, std::memory_order_relaxed))
+    {
+    }
+}
+
+void W1RealtimeThread::histogram_s::reset()
+{
+    for (int i = 0; i <= W1RT_HISTOGRAM_FINE + W1RT_HISTOGRAM_COARSE; i++)
+    {
+        buckets[i].store(0, std::memory_order_relaxed);
+    }
+    maxUs.store(0, std::memory_order_relaxed);
+}
+
+uint32_t W1RealtimeThread::histogram_s::percentile(double p) const
+{
+    uint64_t total = 0;
+    for (int i = 0; i <= W1RT_HISTOGRAM_FINE + W1RT_HISTOGRAM_COARSE; i++)
+    {
+        total += buckets[i].load(std::memory_order_relaxed);
+    }
+    if (total == 0)
+    {
+        return 0;
+    }
+
+    uint64_t target = (uint64_t) (total * p);
+    uint64_t seen = 0;
+    for (int i = 0; i <= W1RT_HISTOGRAM_FINE + W1RT_HISTOGRAM_COARSE; i++)
+    {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen > target)
+        {
+            // upper bound of the bucket, but never above the largest sample
+            uint32_t bound = i < W1RT_HISTOGRAM_FINE ? i : (i - W1RT_HISTOGRAM_FINE + 2) * 1000;
+            uint32_t max = maxUs.load(std::memory_order_relaxed);
+            return bound < max ? bound : max;
+        }
+    }
+
+    return maxUs.load(std::memory_order_relaxed);
+}
+
+//------------------------------------------------------------------------------
+// Thread
+//------------------------------------------------------------------------------
+W1RealtimeThread::W1RealtimeThread()
+    : cycleCount(0), overrunCount(0), failureCount(0)
+{
+    resetStats();
+}
+
+W1RealtimeThread::~W1RealtimeThread()
+{
+    stop();
+}
+
+void W1RealtimeThread::setPriority(int _priority)
+{
+    priority = _priority;
+}
+
+void W1RealtimeThread::setCpu(int _cpu)
+{
+    cpu = _cpu;
+}
+
+void W1RealtimeThread::setLockMemory(bool _lockMemory)
+{
+    lockMemory = _lockMemory;
+}
+
+void W1RealtimeThread::resetStats()
+{
+    latency.reset();
+    duration.reset();
+    cycleCount = 0;
+    overrunCount = 0;
+    failureCount = 0;
+}
+
+int W1RealtimeThread::start(std::function<void()> _body)
+{
+    if (running)
+    {
+        fprintf(stderr, "Real-time thread already running\n");
+        return -1;
+    }
+
+    if (lockMemory && mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+    {
+        fprintf(stderr, "Could not lock memory: %m\n");
+        return -1;
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+
+    if (priority > 0)
+    {
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = priority;
+        pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+        pthread_attr_setschedparam(&attr, &param);
+    }
+
+    if (cpu >= 0)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+        pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+    }
+
+    body = _body;
+    stopRequested = false;
+
+    int ret = pthread_create(&thread, &attr, threadMain, this);
+    pthread_attr_destroy(&attr);
+    if (ret != 0)
+    {
+        fprintf(stderr, "Could not create real-time thread (priority %d, cpu %d): %s\n",
+                priority, cpu, strerror(ret));
+        return -1;
+    }
+
+    running = true;
+
+    return 0;
+}
+
+int W1RealtimeThread::startPeriodic(int _periodUs, std::function<int()> _cycle)
+{
+    if (_periodUs <= 0)
+    {
+        fprintf(stderr, "Invalid period %d us\n", _periodUs);
+        return -1;
+    }
+
+    periodUs = _periodUs;
+    cycle = _cycle;
+
+    return start([this] { periodicLoop(); });
+}
+
+void W1RealtimeThread::stop()
+{
+    stopRequested = true;
+    join();
+}
+
+void W1RealtimeThread::join()
+{
+    if (running)
+    {
+        pthread_join(thread, NULL);
+        running = false;
+    }
+}
+
+void *W1RealtimeThread::threadMain(void *arg)
+{
+    W1RealtimeThread *self = (W1RealtimeThread *) arg;
+
+    // touch the stack now, not on the first deep call in the hot path
+    volatile uint8_t stack[W1RT_PREFAULT_STACK];
+    for (int i = 0; i < W1RT_PREFAULT_STACK; i += 4096)
+    {
+        stack[i] = 0;
+    }
+    (void) stack;
+
+    self->body();
+
+    return NULL;
+}
+
+void W1RealtimeThread::periodicLoop()
+{
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    while (!stopRequested)
+    {
+        next.tv_nsec += (int64_t) periodUs * 1000;
+        while (next.tv_nsec >= NSEC_PER_SEC)
+        {
+            next.tv_nsec -= NSEC_PER_SEC;
+            next.tv_sec++;
+        }
+
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+        struct timespec woke, done;
+        clock_gettime(CLOCK_MONOTONIC, &woke);
+        if (cycle() < 0)
+        {
+            failureCount.fetch_add(1, std::memory_order_relaxed);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &done);
+
+        int64_t late = timespec_ns(woke) - timespec_ns(next);
+        int64_t took = timespec_ns(done) - timespec_ns(woke);
+        latency.add(late > 0 ? late / 1000 : 0);
+        duration.add(took / 1000);
+        cycleCount.fetch_add(1, std::memory_order_relaxed);
+
+        // skip the releases we missed instead of running a burst
+        if (timespec_ns(done) - timespec_ns(next) > (int64_t) periodUs * 1000)
+        {
+            overrunCount.fetch_add(1, std::memory_order_relaxed);
+            next = done;
+        }
+    }
+}
+
+void W1RealtimeThread::printJitterReport(FILE *f) const
+{
+    fprintf(f, "cycles %llu, overruns %llu, failures %llu (period %d us, priority %d, cpu %d)\n",
+            (unsigned long long) cycleCount.load(), (unsigned long long) overrunCount.load(),
+            (unsigned long long) failureCount.load(), periodUs, priority, cpu);
+    fprintf(f, "%-14s %8s %8s %8s %8s %8s\n", "us", "p50", "p90", "p99", "p99.9", "max");
+    fprintf(f, "%-14s %8u %8u %8u %8u %8u\n", "wakeup late",
+            latency.percentile(0.5), latency.percentile(0.9), latency.percentile(0.99),
+            latency.percentile(0.999), latency.maxUs.load());
+    fprintf(f, "%-14s %8u %8u %8u %8u %8u\n", "cycle",
+            duration.percentile(0.5), duration.percentile(0.9), duration.percentile(0.99),
+            duration.percentile(0.999), duration.maxUs.load());
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include <atomic>
+#include <functional>
+
+#define W1RT_HISTOGRAM_FINE   1000 // 1 us buckets up to 1 ms
+#define W1RT_HISTOGRAM_COARSE 200  // 1 ms buckets up to 200 ms
+#define W1RT_PREFAULT_STACK   (64 * 1024)
+
+/*!
+ * \class W1RealtimeThread
+ *
+ * \brief Runs bus code in a thread with real-time scheduling
+ *
+ * The thread is created with SCHED_FIFO at the configured priority, can be
+ * pinned to one CPU and locks all process memory. Its stack is prefaulted
+ * before the body runs. In periodic mode the wakeup latency and the cycle
+ * duration are collected into preallocated histograms, the thread itself
+ * never allocates or prints; printJitterReport() is meant to be called
+ * from another thread.
+ *
+ * The body has to follow the same rules, e.g. call DS2482::setLogging(false)
+ * and use the allocation free DS2482::findDevices() variant.
+ */
+class W1RealtimeThread
+{
+public:
+    W1RealtimeThread();
+    ~W1RealtimeThread();
+
+    // SCHED_FIFO priority 1-99, 0 keeps the default scheduler
+    void setPriority(int priority);
+    // CPU to pin the thread to, -1 for no affinity
+    void setCpu(int cpu);
+    // mlockall() current and future memory before starting
+    void setLockMemory(bool lockMemory);
+
+    /*!
+     * \brief start - runs body once in the configured thread
+     * \return 0 on success, -1 if the thread could not be created
+     */
+    int start(std::function<void()> body);
+    /*!
+     * \brief startPeriodic - calls cycle every periodUs until stop()
+     * \return 0 on success, -1 if the thread could not be created
+     */
+    int startPeriodic(int periodUs, std::function<int()> cycle);
+    /*!
+     * \brief stop - requests the periodic loop to end and joins the thread
+     */
+    void stop();
+    /*!
+     * \brief join - waits for the thread to end
+     */
+    void join();
+
+    std::atomic<bool> *stopFlag() { return &stopRequested; }
+
+    uint64_t cycles() const { return cycleCount; }
+    uint64_t overruns() const { return overrunCount; }
+    uint64_t failures() const { return failureCount; }
+
+    void resetStats();
+    void printJitterReport(FILE *f) const;
+
+private:
+    struct histogram_s {
+        std::atomic<uint32_t> buckets[W1RT_HISTOGRAM_FINE + W1RT_HISTOGRAM_COARSE + 1];
+        std::atomic<uint32_t> maxUs;
+
+        void add(uint32_t us);
+        void reset();
+        uint32_t percentile(double p) const;
+    };
+
+    static void *threadMain(void *arg);
+    void periodicLoop();
+
+    int priority = 0;
+    int cpu = -1;
+    bool lockMemory = true;
+
+    pthread_t thread;
+    bool running = false;
+    std::atomic<bool> stopRequested { false };
+
+    std::function<void()> body;
+    std::function<int()> cycle;
+    int periodUs = 0;
+
+    histogram_s latency;
+    histogram_s duration;
+    std::atomic<uint64_t> cycleCount;
+    std::atomic<uint64_t> overrunCount;
+    std::atomic<uint64_t> failureCount;
+};
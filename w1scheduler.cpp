@@ -0,0 +1,321 @@
+#include "w1scheduler.h"
+
+#include "w1clock.h"
+
+struct W1Scheduler::job_s {
+    job_stats_t stats;
+    job_fn_t fn;
+    int64_t periodUs;
+    int64_t release;
+};
+
+W1Scheduler::W1Scheduler(DS2482 &_ds)
+    : ds(_ds)
+{
+    statsSince = w1_now_us();
+}
+
+W1Scheduler::~W1Scheduler()
+{
+    foreach (job_s *job, jobs)
+    {
+        delete job;
+    }
+    delete background;
+}
+
+int W1Scheduler::addJob(QString name, int periodMs, int priority, job_fn_t fn)
+{
+    if (periodMs <= 0 || !fn)
+    {
+        fprintf(stderr, "Invalid job %s\n", name.toLatin1().constData());
+        return -1;
+    }
+
+    job_s *job = new job_s();
+    job->stats.id = nextId++;
+    job->stats.name = name;
+    job->stats.periodMs = periodMs;
+    job->stats.priority = priority;
+    job->fn = fn;
+    job->periodUs = (int64_t) periodMs * 1000;
+    job->release = w1_now_us();
+
+    jobs << job;
+
+    return job->stats.id;
+}
+
+void W1Scheduler::removeJob(int id)
+{
+    for (int i = 0; i < jobs.count(); i++)
+    {
+        if (jobs[i]->stats.id == id)
+        {
+            delete jobs[i];
+            jobs.removeAt(i);
+            return;
+        }
+    }
+}
+
+void W1Scheduler::setBackgroundJob(QString name, int minIntervalMs, job_fn_t fn,
+                                   int firstDelayMs)
+{
+    delete background;
+    background = nullptr;
+
+    if (!fn)
+    {
+        return;
+    }
+
+    background = new job_s();
+    background->stats.id = -1;
+    background->stats.name = name;
+    background->stats.periodMs = minIntervalMs;
+    background->stats.priority = 0;
+    background->fn = fn;
+    background->periodUs = (int64_t) minIntervalMs * 1000;
+    background->release = w1_now_us() + (int64_t) firstDelayMs * 1000;
+}
+
+void W1Scheduler::runJob(job_s &job, int64_t start)
+{
+    int ret = job.fn(ds);
+    int64_t end = w1_now_us();
+    uint32_t duration = end - start;
+
+    job.stats.runs++;
+    job.stats.busyUs += duration;
+    if (ret < 0)
+    {
+        job.stats.failures++;
+    }
+    if (duration > job.stats.worstUs)
+    {
+        job.stats.worstUs = duration;
+    }
+    // exponential moving average, weight 1/8
+    if (job.stats.estimateUs == 0)
+    {
+        job.stats.estimateUs = duration;
+    } else {
+        job.stats.estimateUs += ((int64_t) duration - job.stats.estimateUs) / 8;
+    }
+}
+
+int W1Scheduler::runOnce()
+{
+    int64_t now = w1_now_us();
+
+    job_s *next = nullptr;
+    int64_t nextRelease = INT64_MAX;
+    foreach (job_s *job, jobs)
+    {
+        if (job->release > now)
+        {
+            if (job->release < nextRelease)
+            {
+                nextRelease = job->release;
+            }
+            continue;
+        }
+
+        if (next == nullptr
+                || job->release + job->periodUs < next->release + next->periodUs
+                || (job->release + job->periodUs == next->release + next->periodUs
+                    && job->stats.priority > next->stats.priority))
+        {
+            next = job;
+        }
+    }
+
+    // an overdue background job competes with the deadline of a whole
+    // interval after its release instead of waiting for a gap forever
+    if (background != nullptr && background->release + background->periodUs <= now
+            && (next == nullptr || background->release + background->periodUs
+                                   < next->release + next->periodUs))
+    {
+        background->stats.promotions++;
+        runJob(*background, now);
+        background->release = w1_now_us() + background->periodUs;
+        return 1;
+    }
+
+    if (next != nullptr)
+    {
+        int64_t deadline = next->release + next->periodUs;
+        runJob(*next, now);
+        int64_t end = w1_now_us();
+
+        if (end > deadline)
+        {
+            next->stats.missedDeadlines++;
+        }
+
+        // releases that passed while we were late are dropped, not queued up
+        next->release = deadline;
+        if (next->release + next->periodUs <= end)
+        {
+            int64_t skipped = (end - next->release) / next->periodUs;
+            next->stats.missedDeadlines += skipped;
+            next->release += skipped * next->periodUs;
+        }
+
+        return 1;
+    }
+
+    if (background != nullptr && background->release <= now
+            && (jobs.isEmpty() || now + background->stats.estimateUs <= nextRelease))
+    {
+        runJob(*background, now);
+        background->release = w1_now_us() + background->periodUs;
+        return 1;
+    }
+
+    if (background != nullptr && background->release <= now)
+    {
+        // the background job does not fit into this gap
+        background->stats.missedDeadlines++;
+    }
+
+    int64_t wakeup = nextRelease;
+    if (background != nullptr && background->release > now && background->release < wakeup)
+    {
+        wakeup = background->release;
+    }
+    if (wakeup == INT64_MAX)
+    {
+        return 0;
+    }
+
+    w1_sleep_until_us(wakeup);
+
+    return 0;
+}
+
+void W1Scheduler::run(const std::atomic<bool> *stop)
+{
+    while (!*stop)
+    {
+        runOnce();
+    }
+}
+
+//------------------------------------------------------------------------------
+// Statistics
+//------------------------------------------------------------------------------
+QList<W1Scheduler::job_stats_t> W1Scheduler::jobStats() const
+{
+    QList<job_stats_t> result;
+    foreach (job_s *job, jobs)
+    {
+        result << job->stats;
+    }
+    return result;
+}
+
+W1Scheduler::job_stats_t W1Scheduler::backgroundStats() const
+{
+    if (background == nullptr)
+    {
+        return job_stats_t();
+    }
+    return background->stats;
+}
+
+double W1Scheduler::utilisation() const
+{
+    int64_t elapsed = w1_now_us() - statsSince;
+    if (elapsed <= 0)
+    {
+        return 0;
+    }
+
+    uint64_t busy = 0;
+    foreach (job_s *job, jobs)
+    {
+        busy += job->stats.busyUs;
+    }
+    if (background != nullptr)
+    {
+        busy += background->stats.busyUs;
+    }
+
+    return (double) busy / elapsed;
+}
+
+double W1Scheduler::plannedUtilisation() const
+{
+    double result = 0;
+    foreach (job_s *job, jobs)
+    {
+        result += (double) job->stats.estimateUs / job->periodUs;
+    }
+    return result;
+}
+
+uint64_t W1Scheduler::missedDeadlines() const
+{
+    uint64_t result = 0;
+    foreach (job_s *job, jobs)
+    {
+        result += job->stats.missedDeadlines;
+    }
+    return result;
+}
+
+void W1Scheduler::resetStats()
+{
+    foreach (job_s *job, jobs)
+    {
+        job->stats.runs = 0;
+        job->stats.failures = 0;
+        job->stats.missedDeadlines = 0;
+        job->stats.busyUs = 0;
+        job->stats.worstUs = 0;
+    }
+    if (background != nullptr)
+    {
+        background->stats.runs = 0;
+        background->stats.failures = 0;
+        background->stats.missedDeadlines = 0;
+        background->stats.promotions = 0;
+        background->stats.busyUs = 0;
+        background->stats.worstUs = 0;
+    }
+    statsSince = w1_now_us();
+}
+
+void W1Scheduler::printReport(FILE *f) const
+{
+    fprintf(f, "%-16s %8s %8s %8s %8s %8s %8s\n",
+            "job", "period", "runs", "missed", "failed", "avg us", "max us");
+    foreach (job_s *job, jobs)
+    {
+        fprintf(f, "%-16s %8d %8llu %8llu %8llu %8u %8u\n",
+                job->stats.name.toLatin1().constData(), job->stats.periodMs,
+                (unsigned long long) job->stats.runs,
+                (unsigned long long) job->stats.missedDeadlines,
+                (unsigned long long) job->stats.failures,
+                job->stats.estimateUs, job->stats.worstUs);
+    }
+    if (background != nullptr)
+    {
+        fprintf(f, "%-16s %8s %8llu %8llu %8llu %8u %8u\n",
+                background->stats.name.toLatin1().constData(), "idle",
+                (unsigned long long) background->stats.runs,
+                (unsigned long long) background->stats.missedDeadlines,
+                (unsigned long long) background->stats.failures,
+                background->stats.estimateUs, background->stats.worstUs);
+        if (background->stats.promotions > 0)
+        {
+            fprintf(f, "%s found no idle gap %llu times and ran past its interval\n",
+                    background->stats.name.toLatin1().constData(),
+                    (unsigned long long) background->stats.promotions);
+        }
+    }
+    fprintf(f, "bus utilisation: %.1f%% measured, %.1f%% planned\n",
+            utilisation() * 100, plannedUtilisation() * 100);
+}
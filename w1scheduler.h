@@ -0,0 +1,110 @@
+#pragma once
+
+#include <QList>
+#include <QString>
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+
+#include "ds2482.h"
+
+/*!
+ * \class W1Scheduler
+ *
+ * \brief Earliest-deadline-first polling scheduler for jobs sharing one DS2482
+ *
+ * Every job is released once per period and has to be done before its next
+ * release. Ready jobs run in deadline order, the priority only breaks ties.
+ * When no job is ready, the gap until the next release is filled with the
+ * background job (typically a discovery scan) if its measured duration fits.
+ * A background job that found no such gap for a whole interval after its
+ * release is promoted and runs like a periodic job past its deadline.
+ */
+class W1Scheduler
+{
+public:
+    /*!
+     * job callback, returns a negative value on failure
+     */
+    typedef std::function<int(DS2482 &)> job_fn_t;
+
+    struct job_stats_t {
+        int id;
+        QString name;
+        int periodMs;
+        int priority;
+        uint64_t runs;
+        uint64_t failures;
+        uint64_t missedDeadlines; // background job: gaps too short to run it
+        uint64_t promotions;      // background job: runs forced after waiting an interval
+        uint64_t busyUs;
+        uint32_t estimateUs;
+        uint32_t worstUs;
+    };
+
+    W1Scheduler(DS2482 &ds);
+    ~W1Scheduler();
+
+    /*!
+     * \brief addJob - registers a periodic job, the first release is immediate
+     * \param name - name used in the report
+     * \param periodMs - polling period, also the relative deadline
+     * \param priority - higher priority wins between equal deadlines
+     * \param fn - job callback
+     * \return job id, -1 on failure
+     */
+    int addJob(QString name, int periodMs, int priority, job_fn_t fn);
+    void removeJob(int id);
+
+    /*!
+     * \brief setBackgroundJob - sets the job used to fill idle bus time
+     * \param name - name used in the report
+     * \param minIntervalMs - minimum time between two background runs
+     * \param fn - job callback, an empty function disables background work
+     * \param firstDelayMs - delay before the first background run
+     */
+    void setBackgroundJob(QString name, int minIntervalMs, job_fn_t fn, int firstDelayMs = 0);
+
+    /*!
+     * \brief runOnce - runs the next due job, the background job or sleeps
+     * until the next release
+     * \return 1 if a job was run, 0 if the scheduler slept
+     */
+    int runOnce();
+    /*!
+     * \brief run - calls runOnce() until *stop becomes true
+     */
+    void run(const std::atomic<bool> *stop);
+
+    QList<job_stats_t> jobStats() const;
+    job_stats_t backgroundStats() const;
+
+    /*!
+     * \brief utilisation - measured fraction of wall time the bus was busy
+     * since the last resetStats()
+     */
+    double utilisation() const;
+    /*!
+     * \brief plannedUtilisation - sum of estimated job duration / period,
+     * values close to 1.0 mean the bus is fully booked
+     */
+    double plannedUtilisation() const;
+    uint64_t missedDeadlines() const;
+
+    void resetStats();
+    void printReport(FILE *f) const;
+
+private:
+    struct job_s;
+
+    void runJob(job_s &job, int64_t start);
+
+    DS2482 &ds;
+    QList<job_s *> jobs;
+    job_s *background = nullptr;
+    int nextId = 0;
+    int64_t statsSince = 0;
+};
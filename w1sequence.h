@@ -0,0 +1,158 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include "w1bridge.h"
+
+#define W1SEQ_MAX_FRAME 64
+
+#define W1SEQ_OK         0
+#define W1SEQ_BUS_ERROR  -1
+#define W1SEQ_CRC_ERROR  -2
+
+/*!
+ * \brief CRC coverage of a sequence
+ */
+enum w1sequence_crc_t {
+    W1SEQ_NO_CRC,   // nothing follows the response
+    W1SEQ_CRC16     // inverted CRC16 over command, address, payload and response
+};
+
+/*!
+ * \brief w1seq_crc16 - compile time version of W1Bridge::w1_update_data_crc()
+ */
+constexpr uint16_t w1seq_crc16(uint16_t crc, uint8_t value)
+{
+    crc ^= value;
+    for (int i = 0; i < 8; i++)
+    {
+        crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+    }
+    return crc;
+}
+
+/*!
+ * \class W1Sequence
+ *
+ * \brief Fixed layout 1-wire transaction following a ROM command
+ *
+ * The frame is laid out as
+ *
+ *   command | address (little endian) | payload | response | CRC16
+ *
+ * Command, address and payload are written, response and CRC are read. All
+ * sizes and the CRC seed of the command byte are compile time constants, so
+ * execute() compiles to a fixed write, a fixed read and, if the sequence has
+ * a CRC, one table run over the bytes behind the command. Sequences that do
+ * not fit a frame are rejected at compile time.
+ *
+ * The caller selects the device first (match ROM, skip ROM or resume).
+ */
+template<uint8_t Command, int AddressLen, int PayloadLen, int ResponseLen, w1sequence_crc_t Crc>
+class W1Sequence
+{
+public:
+    static_assert(AddressLen >= 0 && AddressLen <= 2, "1-wire addresses are at most 2 bytes");
+    static_assert(PayloadLen >= 0 && ResponseLen >= 0, "negative field size");
+    static_assert(Crc == W1SEQ_NO_CRC || AddressLen + PayloadLen + ResponseLen > 0,
+                  "CRC without data");
+
+    enum {
+        command = Command,
+        addressLen = AddressLen,
+        payloadLen = PayloadLen,
+        responseLen = ResponseLen,
+        crcLen = Crc == W1SEQ_CRC16 ? 2 : 0,
+        writeLen = 1 + AddressLen + PayloadLen,
+        readLen = ResponseLen + crcLen,
+        frameLen = writeLen + readLen
+    };
+    static_assert(frameLen <= W1SEQ_MAX_FRAME, "sequence does not fit a frame");
+
+    // running CRC after the command byte, precomputed
+    static constexpr uint16_t crcSeed = w1seq_crc16(0, Command);
+
+    W1Sequence()
+    {
+        memset(frame, 0, sizeof(frame));
+        frame[0] = Command;
+    }
+
+    void setAddress(int address)
+    {
+        static_assert(AddressLen > 0, "sequence has no address");
+        frame[1] = address & 0xFF;
+        if (AddressLen > 1)
+        {
+            frame[2] = address >> 8;
+        }
+    }
+
+    uint8_t *payload() { return frame + 1 + AddressLen; }
+    const uint8_t *response() const { return frame + writeLen; }
+    const uint8_t *data() const { return frame; }
+
+    /*!
+     * \brief execute - writes the command and reads the response
+     * \param ds - bridge with the device already selected
+     * \param strongPullup - enables the strong pullup before the last
+     * written byte, for commands that draw programming current afterwards
+     * \return W1SEQ_OK, W1SEQ_BUS_ERROR or W1SEQ_CRC_ERROR
+     */
+    int execute(W1Bridge &ds, bool strongPullup = false)
+    {
+        if (strongPullup)
+        {
+            if (ds.w1_write_block(frame, writeLen - 1) != 0)
+            {
+                return W1SEQ_BUS_ERROR;
+            }
+            ds.set_strong_pullup(true);
+            if (ds.w1_write_byte(frame[writeLen - 1]) != 0)
+            {
+                return W1SEQ_BUS_ERROR;
+            }
+        } else if (ds.w1_write_block(frame, writeLen) != 0) {
+            return W1SEQ_BUS_ERROR;
+        }
+
+        if (readLen > 0 && ds.w1_read_block(frame + writeLen, readLen) < 0)
+        {
+            return W1SEQ_BUS_ERROR;
+        }
+
+        if (Crc == W1SEQ_CRC16)
+        {
+            uint16_t crc = ~W1Bridge::w1_update_data_crc(crcSeed, frame + 1, frameLen - 3);
+            if ((frame[frameLen - 2] | (frame[frameLen - 1] << 8)) != crc)
+            {
+                return W1SEQ_CRC_ERROR;
+            }
+        }
+
+        return W1SEQ_OK;
+    }
+
+private:
+    uint8_t frame[frameLen];
+};
+
+template<uint8_t Command, int AddressLen, int PayloadLen, int ResponseLen, w1sequence_crc_t Crc>
+constexpr uint16_t W1Sequence<Command, AddressLen, PayloadLen, ResponseLen, Crc>::crcSeed;
+
+//------------------------------------------------------------------------------
+// DS2431
+//------------------------------------------------------------------------------
+// TA1 TA2, row data, CRC16
+typedef W1Sequence<W1Bridge::DS2431_CMD_WRITE_SCRATCHPAD, 2, DS2431_ROW_SIZE, 0, W1SEQ_CRC16>
+    DS2431WriteScratchpad;
+// same without the CRC, several devices would answer a broadcast at once
+typedef W1Sequence<W1Bridge::DS2431_CMD_WRITE_SCRATCHPAD, 2, DS2431_ROW_SIZE, 0, W1SEQ_NO_CRC>
+    DS2431BroadcastScratchpad;
+// response is TA1 TA2 E/S and the row data
+typedef W1Sequence<W1Bridge::DS2431_CMD_READ_SCRATCHPAD, 0, 0, 3 + DS2431_ROW_SIZE, W1SEQ_CRC16>
+    DS2431ReadScratchpad;
+// TA1 TA2 and E/S as authorisation
+typedef W1Sequence<W1Bridge::DS2431_CMD_COPY_SCRATCHPAD, 2, 1, 0, W1SEQ_NO_CRC>
+    DS2431CopyScratchpad;
@@ -0,0 +1,274 @@
+#include "w1shm.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define W1SHM_READ_RETRIES 1000
+
+//------------------------------------------------------------------------------
+// Writer
+//------------------------------------------------------------------------------
+W1ShmWriter::W1ShmWriter()
+{
+
+}
+
+W1ShmWriter::~W1ShmWriter()
+{
+    close();
+}
+
+int W1ShmWriter::open(QString _name)
+{
+    int fd = shm_open(_name.toLatin1().constData(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Could not open shared memory %s: %m\n", _name.toLatin1().constData());
+        return -1;
+    }
+
+    if (ftruncate(fd, sizeof(w1shm_segment_t)) != 0)
+    {
+        fprintf(stderr, "Could not size shared memory: %m\n");
+        ::close(fd);
+        return -1;
+    }
+
+    void *mem = mmap(NULL, sizeof(w1shm_segment_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mem == MAP_FAILED)
+    {
+        fprintf(stderr, "Could not map shared memory: %m\n");
+        return -1;
+    }
+
+    name = _name;
+    segment = (w1shm_segment_t *) mem;
+
+    // readers that see an odd sequence wait for the initialisation to finish
+    segment->seq.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    segment->magic = W1SHM_MAGIC;
+    segment->version = W1SHM_VERSION;
+    segment->deviceCount = 0;
+    segment->generation = 0;
+    segment->lastScanUs = 0;
+    segment->seq.store(2, std::memory_order_release);
+
+    return 0;
+}
+
+void W1ShmWriter::close()
+{
+    if (segment != nullptr)
+    {
+        munmap(segment, sizeof(w1shm_segment_t));
+        shm_unlink(name.toLatin1().constData());
+        segment = nullptr;
+    }
+}
+
+void W1ShmWriter::beginWrite()
+{
+    uint32_t seq = segment->seq.load(std::memory_order_relaxed);
+    segment->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void W1ShmWriter::endWrite()
+{
+    uint32_t seq = segment->seq.load(std::memory_order_relaxed);
+    segment->seq.store(seq + 1, std::memory_order_release);
+}
+
+int W1ShmWriter::publishInventory(const uint64_t *devices, int count, uint64_t scanUs)
+{
+    if (segment == nullptr)
+    {
+        return 0;
+    }
+
+    int dropped = 0;
+    if (count > W1SHM_MAX_DEVICES)
+    {
+        dropped = count - W1SHM_MAX_DEVICES;
+        count = W1SHM_MAX_DEVICES;
+    }
+
+    // build the new table outside of the write section
+    static w1shm_device_t table[W1SHM_MAX_DEVICES];
+    for (int n = 0; n < count; n++)
+    {
+        w1shm_device_t &dev = table[n];
+        memset(&dev, 0, sizeof(dev));
+        dev.rom = devices[n];
+        dev.lastSeenUs = scanUs;
+
+        for (uint32_t i = 0; i < segment->deviceCount; i++)
+        {
+            if (segment->devices[i].rom == dev.rom)
+            {
+                dev.readingUs = segment->devices[i].readingUs;
+                dev.readingLen = segment->devices[i].readingLen;
+                memcpy(dev.reading, segment->devices[i].reading, sizeof(dev.reading));
+                break;
+            }
+        }
+    }
+
+    beginWrite();
+    memcpy(segment->devices, table, count * sizeof(w1shm_device_t));
+    segment->deviceCount = count;
+    segment->generation++;
+    segment->lastScanUs = scanUs;
+    endWrite();
+
+    return dropped;
+}
+
+int W1ShmWriter::publishReading(uint64_t rom, const uint8_t *data, int len, uint64_t timeUs)
+{
+    if (segment == nullptr)
+    {
+        return -1;
+    }
+
+    if (len > W1SHM_READING_SIZE)
+    {
+        len = W1SHM_READING_SIZE;
+    }
+
+    for (uint32_t i = 0; i < segment->deviceCount; i++)
+    {
+        w1shm_device_t &dev = segment->devices[i];
+        if (dev.rom == rom)
+        {
+            beginWrite();
+            memcpy(dev.reading, data, len);
+            dev.readingLen = len;
+            dev.readingUs = timeUs;
+            endWrite();
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+//------------------------------------------------------------------------------
+// Reader
+//------------------------------------------------------------------------------
+W1ShmReader::W1ShmReader()
+{
+
+}
+
+W1ShmReader::~W1ShmReader()
+{
+    close();
+}
+
+int W1ShmReader::open(QString name)
+{
+    int fd = shm_open(name.toLatin1().constData(), O_RDONLY, 0);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Could not open shared memory %s: %m\n", name.toLatin1().constData());
+        return -1;
+    }
+
+    void *mem = mmap(NULL, sizeof(w1shm_segment_t), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mem == MAP_FAILED)
+    {
+        fprintf(stderr, "Could not map shared memory: %m\n");
+        return -1;
+    }
+
+    segment = (const w1shm_segment_t *) mem;
+    if (segment->magic != W1SHM_MAGIC || segment->version != W1SHM_VERSION)
+    {
+        fprintf(stderr, "Shared memory %s has an unknown layout\n", name.toLatin1().constData());
+        close();
+        return -1;
+    }
+
+    return 0;
+}
+
+void W1ShmReader::close()
+{
+    if (segment != nullptr)
+    {
+        munmap((void *) segment, sizeof(w1shm_segment_t));
+        segment = nullptr;
+    }
+}
+
+int W1ShmReader::snapshot(w1shm_segment_t *copy) const
+{
+    if (segment == nullptr)
+    {
+        return -1;
+    }
+
+    for (int i = 0; i < W1SHM_READ_RETRIES; i++)
+    {
+        uint32_t before = segment->seq.load(std::memory_order_acquire);
+        if (before & 1)
+        {
+            continue;
+        }
+
+        copy->magic = segment->magic;
+        copy->version = segment->version;
+        copy->deviceCount = segment->deviceCount;
+        copy->generation = segment->generation;
+        copy->lastScanUs = segment->lastScanUs;
+        uint32_t count = copy->deviceCount;
+        if (count > W1SHM_MAX_DEVICES)
+        {
+            count = W1SHM_MAX_DEVICES;
+        }
+        memcpy(copy->devices, segment->devices, count * sizeof(w1shm_device_t));
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint32_t after = segment->seq.load(std::memory_order_relaxed);
+        if (before == after)
+        {
+            copy->seq.store(before, std::memory_order_relaxed);
+            copy->deviceCount = count;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+QList<w1shm_device_t> W1ShmReader::devices(bool *ok) const
+{
+    QList<w1shm_device_t> result;
+
+    static thread_local w1shm_segment_t copy;
+    int ret = snapshot(&copy);
+    if (ok != nullptr)
+    {
+        *ok = ret == 0;
+    }
+    if (ret != 0)
+    {
+        return result;
+    }
+
+    for (uint32_t i = 0; i < copy.deviceCount; i++)
+    {
+        result << copy.devices[i];
+    }
+
+    return result;
+}
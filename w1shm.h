@@ -0,0 +1,120 @@
+#pragma once
+
+#include <QList>
+#include <QString>
+
+#include <stdint.h>
+
+#include <atomic>
+
+#define W1SHM_MAGIC        0x48533157 // "W1SH"
+#define W1SHM_VERSION      1
+#define W1SHM_MAX_DEVICES  256
+#define W1SHM_READING_SIZE 32
+
+#define W1SHM_DEFAULT_NAME "/onewire"
+
+/*!
+ * \brief one device entry of the shared snapshot, times are CLOCK_MONOTONIC us
+ */
+struct w1shm_device_t {
+    uint64_t rom;
+    uint64_t lastSeenUs;
+    uint64_t readingUs;
+    uint8_t readingLen;
+    uint8_t reading[W1SHM_READING_SIZE];
+};
+
+/*!
+ * \brief layout of the shared memory segment
+ *
+ * seq is a seqlock counter: odd while the daemon is updating the segment.
+ * Readers copy the segment and retry if seq was odd or changed meanwhile.
+ */
+struct w1shm_segment_t {
+    uint32_t magic;
+    uint32_t version;
+    std::atomic<uint32_t> seq;
+    uint32_t deviceCount;
+    uint64_t generation;
+    uint64_t lastScanUs;
+    w1shm_device_t devices[W1SHM_MAX_DEVICES];
+};
+
+/*!
+ * \class W1ShmWriter
+ *
+ * \brief Publishes inventory and readings into the shared segment, only one
+ * writer (the daemon) may exist per segment
+ */
+class W1ShmWriter
+{
+public:
+    W1ShmWriter();
+    ~W1ShmWriter();
+
+    /*!
+     * \brief open - creates (or takes over) the shared memory segment
+     * \param name - shm_open name, for example "/onewire"
+     * \return 0 on success, -1 on failure
+     */
+    int open(QString name);
+    /*!
+     * \brief close - unmaps and removes the segment
+     */
+    void close();
+
+    /*!
+     * \brief publishInventory - replaces the device list, readings of devices
+     * that are still present are kept; does not allocate or print
+     * \return number of devices that did not fit into the segment
+     */
+    int publishInventory(const uint64_t *devices, int count, uint64_t scanUs);
+    /*!
+     * \brief publishReading - stores the latest reading of a known device
+     * \return 0 on success, -1 if the device is not in the inventory
+     */
+    int publishReading(uint64_t rom, const uint8_t *data, int len, uint64_t timeUs);
+
+private:
+    void beginWrite();
+    void endWrite();
+
+    QString name;
+    w1shm_segment_t *segment = nullptr;
+};
+
+/*!
+ * \class W1ShmReader
+ *
+ * \brief Lock-free reader of the shared segment, never touches the bus and
+ * never blocks the daemon or other readers
+ */
+class W1ShmReader
+{
+public:
+    W1ShmReader();
+    ~W1ShmReader();
+
+    /*!
+     * \return 0 on success, -1 on failure
+     */
+    int open(QString name);
+    void close();
+
+    /*!
+     * \brief snapshot - copies a consistent view of the segment
+     * \return 0 on success, -1 if not open or the writer never let go
+     */
+    int snapshot(w1shm_segment_t *copy) const;
+
+    /*!
+     * \brief devices - convenience wrapper around snapshot()
+     * \param ok - set to false if no consistent snapshot could be taken, the
+     * empty list then does not mean an empty bus
+     */
+    QList<w1shm_device_t> devices(bool *ok = nullptr) const;
+
+private:
+    const w1shm_segment_t *segment = nullptr;
+};
@@ -0,0 +1,75 @@
+#include "w1simbridge.h"
+
+W1SimBridge::W1SimBridge(W1SimBus &_bus)
+    : bus(_bus)
+{
+
+}
+
+void W1SimBridge::setOverhead(int us)
+{
+    overheadUs = us;
+}
+
+int W1SimBridge::set_active_pullup(bool)
+{
+    return 0;
+}
+
+int W1SimBridge::set_high_speed(bool highSpeed)
+{
+    bus.setOverdrive(highSpeed);
+    return 0;
+}
+
+int W1SimBridge::set_strong_pullup(bool)
+{
+    return 0;
+}
+
+int W1SimBridge::w1_reset()
+{
+    bus.idle(overheadUs);
+    return bus.reset();
+}
+
+int W1SimBridge::w1_read_bit()
+{
+    bus.idle(overheadUs);
+    return bus.touchBit(1);
+}
+
+int W1SimBridge::w1_write_bit(bit_t bit)
+{
+    bus.idle(overheadUs);
+    bus.touchBit(bit);
+    return 0;
+}
+
+int W1SimBridge::w1_write_byte(uint8_t byte)
+{
+    bus.idle(overheadUs);
+    bus.touchByte(byte);
+    return 0;
+}
+
+int W1SimBridge::w1_read_byte()
+{
+    bus.idle(overheadUs);
+    return bus.touchByte(0xFF);
+}
+
+int W1SimBridge::w1_triplet(bit_t *dir, bit_t *first_bit, bit_t *second_bit)
+{
+    bus.idle(overheadUs);
+
+    *first_bit = bus.touchBit(1);
+    *second_bit = bus.touchBit(1);
+    if (*first_bit != *second_bit)
+    {
+        *dir = *first_bit;
+    }
+    bus.touchBit(*dir);
+
+    return 0;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "w1bridge.h"
+#include "w1simbus.h"
+
+/*!
+ * \class W1SimBridge
+ *
+ * \brief 1-wire master driving a W1SimBus directly
+ *
+ * Runs in the calling thread on the simulated clock of the bus, so long
+ * scenarios take a fraction of their bus time. The round trip of a real
+ * bridge can be modelled with an idle time added to every primitive; a
+ * search triplet counts as one primitive as on the DS2482.
+ */
+class W1SimBridge : public W1Bridge
+{
+public:
+    W1SimBridge(W1SimBus &bus);
+
+    /*!
+     * \brief setOverhead - host and bridge time spent per primitive
+     */
+    void setOverhead(int us);
+
+    int set_active_pullup(bool activePullup) override;
+    int set_high_speed(bool highSpeed) override;
+    int set_strong_pullup(bool strongPullup) override;
+
+    int w1_reset() override;
+    int w1_read_bit() override;
+    int w1_write_bit(bit_t bit) override;
+    int w1_write_byte(uint8_t byte) override;
+    int w1_read_byte() override;
+    int w1_triplet(bit_t *dir, bit_t *first_bit, bit_t *second_bit) override;
+
+private:
+    W1SimBus &bus;
+    int overheadUs = 0;
+};
@@ -0,0 +1,549 @@
+#include "w1simbus.h"
+
+#include <string.h>
+
+#include "w1bridge.h"
+
+struct W1SimBus::device_s {
+    enum state_t {
+        STATE_IDLE,         // waiting for a reset
+        STATE_ROM_COMMAND,
+        STATE_SEARCH,
+        STATE_MATCH,
+        STATE_READ_ROM,
+        STATE_FUNCTION,     // selected, waiting for a function command
+        STATE_ADDRESS,      // receiving the DS2431 target address
+        STATE_SEND,         // streaming memory to the master
+        STATE_PIO           // streaming PIO access read packets
+    };
+
+    uint64_t rom;
+    uint8_t memory[DS2431_MEMORY_SIZE];
+
+    state_t state = STATE_IDLE;
+    bool overdrive = false;
+    bool resumable = false;
+
+    // shift register for received and sent bits
+    int bit = 0;
+    uint8_t byte = 0;
+    int searchPhase = 0;
+    int address = 0;
+    int addressBytes = 0;
+
+    // DS2408 / DS2413 inputs and the packet being sent
+    uint8_t pio = 0xFF;
+    uint8_t packet[34];
+    int packetLen = 0;
+    int packetPos = 0;
+    bool pioFirst = false;
+};
+
+W1SimBus::W1SimBus()
+{
+
+}
+
+W1SimBus::~W1SimBus()
+{
+    foreach (device_s *dev, deviceList)
+    {
+        delete dev;
+    }
+}
+
+uint64_t W1SimBus::makeRom(uint8_t family, uint64_t serial)
+{
+    uint64_t rom = family | ((serial & 0xFFFFFFFFFFFFULL) << 8);
+
+    // Dallas CRC8 (x^8 + x^5 + x^4 + 1, reflected) over the first 7 bytes
+    uint8_t crc = 0;
+    for (int i = 0; i < 56; i++)
+    {
+        uint8_t mix = (crc ^ (rom >> i)) & 1;
+        crc >>= 1;
+        if (mix)
+        {
+            crc ^= 0x8C;
+        }
+    }
+
+    return rom | ((uint64_t) crc << 56);
+}
+
+W1SimBus::device_s *W1SimBus::find(uint64_t rom)
+{
+    foreach (device_s *dev, deviceList)
+    {
+        if (dev->rom == rom)
+        {
+            return dev;
+        }
+    }
+
+    return nullptr;
+}
+
+void W1SimBus::addDevice(uint64_t rom)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    insertDevice(rom);
+}
+
+bool W1SimBus::removeDevice(uint64_t rom)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return eraseDevice(rom);
+}
+
+void W1SimBus::insertDevice(uint64_t rom)
+{
+    if (find(rom) != nullptr)
+    {
+        return;
+    }
+
+    // a device that is plugged in mid transaction waits for the next reset
+    device_s *dev = new device_s;
+    dev->rom = rom;
+    memset(dev->memory, 0xFF, sizeof(dev->memory));
+    deviceList << dev;
+}
+
+bool W1SimBus::eraseDevice(uint64_t rom)
+{
+    for (int i = 0; i < deviceList.count(); i++)
+    {
+        if (deviceList[i]->rom == rom)
+        {
+            delete deviceList.takeAt(i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void W1SimBus::scheduleAdd(uint64_t atUs, uint64_t rom)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    events.insert(std::make_pair(atUs, event_s { rom, true }));
+}
+
+void W1SimBus::scheduleRemove(uint64_t atUs, uint64_t rom)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    events.insert(std::make_pair(atUs, event_s { rom, false }));
+}
+
+void W1SimBus::applyEvents()
+{
+    uint64_t now = busTimeUs + idleTimeUs;
+    while (!events.empty() && events.begin()->first <= now)
+    {
+        const event_s &event = events.begin()->second;
+        if (event.add)
+        {
+            insertDevice(event.rom);
+        } else {
+            eraseDevice(event.rom);
+        }
+        events.erase(events.begin());
+    }
+}
+
+QList<uint64_t> W1SimBus::devices() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    QList<uint64_t> result;
+    foreach (const device_s *dev, deviceList)
+    {
+        result << dev->rom;
+    }
+
+    return result;
+}
+
+int W1SimBus::setMemory(uint64_t rom, int address, const uint8_t *data, int len)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    device_s *dev = find(rom);
+    if (dev == nullptr || address < 0 || len < 0 || address + len > DS2431_MEMORY_SIZE)
+    {
+        return -1;
+    }
+
+    memcpy(dev->memory + address, data, len);
+
+    return 0;
+}
+
+int W1SimBus::setPio(uint64_t rom, uint8_t state)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    device_s *dev = find(rom);
+    if (dev == nullptr)
+    {
+        return -1;
+    }
+    dev->pio = state;
+
+    return 0;
+}
+
+void W1SimBus::setOverdrive(bool overdrive)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    masterOverdrive = overdrive;
+}
+
+bool W1SimBus::overdrive() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return masterOverdrive;
+}
+
+void W1SimBus::idle(uint64_t us)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    idleTimeUs += us;
+    applyEvents();
+}
+
+uint64_t W1SimBus::timeUs() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return busTimeUs;
+}
+
+uint64_t W1SimBus::nowUs() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return busTimeUs + idleTimeUs;
+}
+
+uint64_t W1SimBus::resets() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return resetCount;
+}
+
+uint64_t W1SimBus::slots() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return slotCount;
+}
+
+//------------------------------------------------------------------------------
+// Master side
+//------------------------------------------------------------------------------
+int W1SimBus::reset()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    applyEvents();
+    busTimeUs += masterOverdrive ? W1SIM_RESET_OD_US : W1SIM_RESET_US;
+    resetCount++;
+
+    int presence = 0;
+    foreach (device_s *dev, deviceList)
+    {
+        // a standard speed reset is long enough for every device
+        if (!masterOverdrive)
+        {
+            dev->overdrive = false;
+        } else if (!dev->overdrive) {
+            continue;
+        }
+
+        deviceReset(*dev);
+        presence = 1;
+    }
+
+    return presence;
+}
+
+int W1SimBus::touchBit(int bit)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    applyEvents();
+    busTimeUs += masterOverdrive ? W1SIM_SLOT_OD_US : W1SIM_SLOT_US;
+    slotCount++;
+
+    int level = bit ? 1 : 0;
+    foreach (device_s *dev, deviceList)
+    {
+        if (dev->overdrive == masterOverdrive)
+        {
+            level &= deviceOutput(*dev);
+        }
+    }
+
+    foreach (device_s *dev, deviceList)
+    {
+        if (dev->overdrive == masterOverdrive)
+        {
+            deviceInput(*dev, level);
+        }
+    }
+
+    return level;
+}
+
+uint8_t W1SimBus::touchByte(uint8_t byte)
+{
+    uint8_t result = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        if (touchBit((byte >> i) & 1))
+        {
+            result |= 1 << i;
+        }
+    }
+
+    return result;
+}
+
+//------------------------------------------------------------------------------
+// Devices
+//------------------------------------------------------------------------------
+void W1SimBus::deviceReset(device_s &dev)
+{
+    dev.state = device_s::STATE_ROM_COMMAND;
+    dev.bit = 0;
+    dev.byte = 0;
+    dev.searchPhase = 0;
+}
+
+void W1SimBus::select(device_s &dev)
+{
+    // selecting one device takes the resume flag from all others
+    foreach (device_s *other, deviceList)
+    {
+        other->resumable = false;
+    }
+    dev.resumable = true;
+    dev.state = device_s::STATE_FUNCTION;
+    dev.bit = 0;
+    dev.byte = 0;
+}
+
+int W1SimBus::deviceOutput(device_s &dev)
+{
+    switch (dev.state)
+    {
+    case device_s::STATE_SEARCH:
+        if (dev.searchPhase == 0)
+        {
+            return (dev.rom >> dev.bit) & 1;
+        }
+        if (dev.searchPhase == 1)
+        {
+            return !((dev.rom >> dev.bit) & 1);
+        }
+        return 1;
+    case device_s::STATE_READ_ROM:
+        return (dev.rom >> dev.bit) & 1;
+    case device_s::STATE_SEND:
+        return (dev.memory[dev.address] >> dev.bit) & 1;
+    case device_s::STATE_PIO:
+        return (dev.packet[dev.packetPos] >> dev.bit) & 1;
+    default:
+        return 1;
+    }
+}
+
+void W1SimBus::deviceInput(device_s &dev, int bit)
+{
+    switch (dev.state)
+    {
+    case device_s::STATE_IDLE:
+        return;
+
+    case device_s::STATE_SEARCH:
+        if (dev.searchPhase < 2)
+        {
+            dev.searchPhase++;
+            return;
+        }
+        dev.searchPhase = 0;
+        if (bit != (int) ((dev.rom >> dev.bit) & 1))
+        {
+            dev.state = device_s::STATE_IDLE;
+            return;
+        }
+        if (++dev.bit == 64)
+        {
+            select(dev);
+        }
+        return;
+
+    case device_s::STATE_MATCH:
+        if (bit != (int) ((dev.rom >> dev.bit) & 1))
+        {
+            dev.state = device_s::STATE_IDLE;
+            return;
+        }
+        if (++dev.bit == 64)
+        {
+            select(dev);
+        }
+        return;
+
+    case device_s::STATE_READ_ROM:
+        if (++dev.bit == 64)
+        {
+            select(dev);
+        }
+        return;
+
+    case device_s::STATE_SEND:
+        if (++dev.bit == 8)
+        {
+            dev.bit = 0;
+            // the DS2431 returns 1s behind the end of its memory
+            if (dev.address < DS2431_MEMORY_SIZE - 1)
+            {
+                dev.address++;
+            } else {
+                dev.state = device_s::STATE_IDLE;
+            }
+        }
+        return;
+
+    case device_s::STATE_PIO:
+        if (++dev.bit == 8)
+        {
+            dev.bit = 0;
+            if (++dev.packetPos == dev.packetLen)
+            {
+                dev.pioFirst = false;
+                fillPio(dev);
+            }
+        }
+        return;
+
+    default:
+        break;
+    }
+
+    // byte oriented states
+    dev.byte |= bit << dev.bit;
+    if (++dev.bit < 8)
+    {
+        return;
+    }
+
+    uint8_t byte = dev.byte;
+    dev.bit = 0;
+    dev.byte = 0;
+
+    if (dev.state == device_s::STATE_ROM_COMMAND)
+    {
+        romCommand(dev, byte);
+    } else {
+        functionByte(dev, byte);
+    }
+}
+
+void W1SimBus::romCommand(device_s &dev, uint8_t cmd)
+{
+    switch (cmd)
+    {
+    case W1Bridge::W1_CMD_SEARCH_ROM:
+        dev.state = device_s::STATE_SEARCH;
+        dev.searchPhase = 0;
+        break;
+    case W1Bridge::W1_CMD_READ_ROM:
+        dev.state = device_s::STATE_READ_ROM;
+        break;
+    case W1Bridge::W1_CMD_MATCH_ROM:
+        dev.state = device_s::STATE_MATCH;
+        break;
+    case W1Bridge::W1_CMD_OVERDRIVE_MATCH_ROM:
+        // the id already follows at overdrive speed
+        dev.overdrive = true;
+        dev.state = device_s::STATE_MATCH;
+        break;
+    case W1Bridge::W1_CMD_SKIP_ROM:
+        dev.resumable = false;
+        dev.state = device_s::STATE_FUNCTION;
+        break;
+    case W1Bridge::W1_CMD_OVERDRIVE_SKIP_ROM:
+        dev.resumable = false;
+        dev.overdrive = true;
+        dev.state = device_s::STATE_FUNCTION;
+        break;
+    case W1Bridge::W1_CMD_RESUME:
+        dev.state = dev.resumable ? device_s::STATE_FUNCTION : device_s::STATE_IDLE;
+        break;
+    default:
+        dev.state = device_s::STATE_IDLE;
+        break;
+    }
+}
+
+void W1SimBus::functionByte(device_s &dev, uint8_t byte)
+{
+    if (dev.state == device_s::STATE_ADDRESS)
+    {
+        dev.address |= byte << (8 * dev.addressBytes);
+        if (++dev.addressBytes == 2)
+        {
+            dev.state = dev.address < DS2431_MEMORY_SIZE ? device_s::STATE_SEND
+                                                         : device_s::STATE_IDLE;
+        }
+        return;
+    }
+
+    if ((dev.rom & 0xFF) == DS2431_FAMILY_CODE && byte == W1Bridge::DS2431_CMD_READ_MEMORY)
+    {
+        dev.state = device_s::STATE_ADDRESS;
+        dev.address = 0;
+        dev.addressBytes = 0;
+        return;
+    }
+
+    uint8_t family = dev.rom & 0xFF;
+    if ((family == DS2408_FAMILY_CODE || family == DS2413_FAMILY_CODE)
+            && byte == W1Bridge::PIO_CMD_ACCESS_READ)
+    {
+        dev.state = device_s::STATE_PIO;
+        dev.pioFirst = true;
+        fillPio(dev);
+        return;
+    }
+
+    // other function commands are not simulated
+    dev.state = device_s::STATE_IDLE;
+}
+
+void W1SimBus::fillPio(device_s &dev)
+{
+    dev.packetPos = 0;
+
+    if ((dev.rom & 0xFF) == DS2413_FAMILY_CODE)
+    {
+        // state nibble with its complement, no CRC
+        dev.packet[0] = (dev.pio & 0x0F) | ((~dev.pio & 0x0F) << 4);
+        dev.packetLen = 1;
+        return;
+    }
+
+    // 32 samples and the inverted CRC16, the first one covers the command
+    memset(dev.packet, dev.pio, 32);
+    uint16_t crc = 0;
+    if (dev.pioFirst)
+    {
+        static const uint8_t cmd = W1Bridge::PIO_CMD_ACCESS_READ;
+        crc = W1Bridge::w1_update_data_crc(crc, &cmd, 1);
+    }
+    crc = ~W1Bridge::w1_update_data_crc(crc, dev.packet, 32);
+    dev.packet[32] = crc & 0xFF;
+    dev.packet[33] = crc >> 8;
+    dev.packetLen = 34;
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <QList>
+
+#include <stdint.h>
+
+#include <map>
+#include <mutex>
+
+#define W1SIM_RESET_US     960
+#define W1SIM_RESET_OD_US  100
+#define W1SIM_SLOT_US      65
+#define W1SIM_SLOT_OD_US   10
+
+/*!
+ * \class W1SimBus
+ *
+ * \brief Bit level model of a 1-wire bus with simulated slave devices
+ *
+ * The master side (reset and time slots) is driven by a bridge simulator.
+ * Every device runs the ROM layer (search, read, match, skip, resume and the
+ * overdrive variants). Devices with the DS2431 family code answer read
+ * memory, DS2408 and DS2413 stream their PIO state on access read. The bus
+ * line is the wired AND of the master and all devices.
+ *
+ * Bus time is accumulated from the nominal reset and slot lengths, so callers
+ * can measure what a sequence costs on the wire. Time the master spends off
+ * the wire is added with idle(). Devices can be scripted to appear and
+ * disappear at a given bus time, the events are applied before the reset or
+ * slot that starts at or after that time. All methods are thread-safe,
+ * devices may come and go while a bridge simulator drives the bus.
+ */
+class W1SimBus
+{
+public:
+    W1SimBus();
+    ~W1SimBus();
+
+    /*!
+     * \brief makeRom - builds a device id with a valid CRC
+     * \param family - family code
+     * \param serial - 48 bit serial number
+     */
+    static uint64_t makeRom(uint8_t family, uint64_t serial);
+
+    void addDevice(uint64_t rom);
+    bool removeDevice(uint64_t rom);
+    QList<uint64_t> devices() const;
+    /*!
+     * \brief setMemory - sets the memory of a simulated DS2431
+     * \return 0 on success, -1 if the device is unknown or the range invalid
+     */
+    int setMemory(uint64_t rom, int address, const uint8_t *data, int len);
+    /*!
+     * \brief setPio - sets the input state a simulated DS2408 or DS2413 reports
+     * \return 0 on success, -1 if the device is unknown
+     */
+    int setPio(uint64_t rom, uint8_t state);
+
+    /*!
+     * \brief scheduleAdd - plugs a device in at a bus time, see nowUs()
+     */
+    void scheduleAdd(uint64_t atUs, uint64_t rom);
+    void scheduleRemove(uint64_t atUs, uint64_t rom);
+
+    //------------------------------------------------------------------------------
+    // Master side
+    //------------------------------------------------------------------------------
+    void setOverdrive(bool overdrive);
+    bool overdrive() const;
+
+    /*!
+     * \return 1 if a device answered with a presence pulse, 0 otherwise
+     */
+    int reset();
+    /*!
+     * \brief touchBit - runs one time slot, writing 1 is a read slot
+     * \return the bus level sampled by the master
+     */
+    int touchBit(int bit);
+    uint8_t touchByte(uint8_t byte);
+
+    /*!
+     * \brief idle - advances the clock without bus activity, e.g. for bridge
+     * round trips or the pause between two scans
+     */
+    void idle(uint64_t us);
+
+    /*!
+     * \brief timeUs - bus time spent in resets and slots so far
+     */
+    uint64_t timeUs() const;
+    /*!
+     * \brief nowUs - simulated time, bus time plus idle time
+     */
+    uint64_t nowUs() const;
+    uint64_t resets() const;
+    uint64_t slots() const;
+
+private:
+    struct device_s;
+
+    struct event_s {
+        uint64_t rom;
+        bool add;
+    };
+
+    device_s *find(uint64_t rom);
+    void insertDevice(uint64_t rom);
+    bool eraseDevice(uint64_t rom);
+    void applyEvents();
+    void deviceReset(device_s &dev);
+    int deviceOutput(device_s &dev);
+    void deviceInput(device_s &dev, int bit);
+    void romCommand(device_s &dev, uint8_t cmd);
+    void functionByte(device_s &dev, uint8_t byte);
+    void select(device_s &dev);
+    void fillPio(device_s &dev);
+
+    mutable std::mutex mutex;
+    QList<device_s *> deviceList;
+    bool masterOverdrive = false;
+    uint64_t busTimeUs = 0;
+    uint64_t idleTimeUs = 0;
+    std::multimap<uint64_t, event_s> events;
+    uint64_t resetCount = 0;
+    uint64_t slotCount = 0;
+};
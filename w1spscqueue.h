@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+
+/*!
+ * \class W1SpscQueue
+ *
+ * \brief Fixed size lock-free queue between one producer and one consumer
+ *
+ * Neither side allocates, blocks or enters the kernel, so a W1RealtimeThread
+ * can hand work to an ordinary thread with it. Items are copied in and out.
+ */
+template<typename T, int N>
+class W1SpscQueue
+{
+public:
+    W1SpscQueue() : head(0), tail(0) {}
+
+    /*!
+     * \brief push - producer side
+     * \return false if the queue is full, the item is not queued
+     */
+    bool push(const T &item)
+    {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) >= (uint32_t) N)
+        {
+            return false;
+        }
+
+        items[h % N] = item;
+        head.store(h + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    /*!
+     * \brief pop - consumer side
+     * \return true if an item was taken
+     */
+    bool pop(T *item)
+    {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        *item = items[t % N];
+        tail.store(t + 1, std::memory_order_release);
+
+        return true;
+    }
+
+private:
+    T items[N];
+    std::atomic<uint32_t> head;
+    std::atomic<uint32_t> tail;
+};
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+/*!
+ * \brief result storage of a W1Task promise, specialised for void
+ */
+template<typename T>
+struct w1task_result_s {
+    T value {};
+
+    void return_value(T _value) { value = std::move(_value); }
+    T result() { return std::move(value); }
+};
+
+template<>
+struct w1task_result_s<void> {
+    void return_void() {}
+    void result() {}
+};
+
+/*!
+ * \class W1Task
+ *
+ * \brief Lazily started coroutine returning a T
+ *
+ * A task runs when it is awaited (or spawned on a W1Executor) and resumes
+ * its awaiter when it finishes, without going through the executor. Tasks
+ * own their frame and are move-only. Exceptions are not used in this code
+ * base, one escaping a task terminates the program.
+ */
+template<typename T = void>
+class W1Task
+{
+public:
+    struct promise_type;
+    typedef std::coroutine_handle<promise_type> handle_t;
+
+    struct final_awaiter {
+        bool await_ready() noexcept { return false; }
+        std::coroutine_handle<> await_suspend(handle_t handle) noexcept
+        {
+            // continue the awaiter directly, a root task just stops
+            std::coroutine_handle<> next = handle.promise().continuation;
+            return next ? next : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+
+    struct promise_type : w1task_result_s<T> {
+        std::coroutine_handle<> continuation;
+
+        W1Task get_return_object() { return W1Task(handle_t::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        final_awaiter final_suspend() noexcept { return {}; }
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    W1Task() {}
+    W1Task(W1Task &&other) : handle(std::exchange(other.handle, nullptr)) {}
+    W1Task &operator=(W1Task &&other)
+    {
+        if (this != &other)
+        {
+            reset();
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+    ~W1Task() { reset(); }
+
+    W1Task(const W1Task &) = delete;
+    W1Task &operator=(const W1Task &) = delete;
+
+    bool valid() const { return (bool) handle; }
+    bool done() const { return !handle || handle.done(); }
+    std::coroutine_handle<> coroutine() const { return handle; }
+
+    // co_await task starts it and suspends the caller until it is done
+    bool await_ready() const { return done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller)
+    {
+        handle.promise().continuation = caller;
+        return handle;
+    }
+    T await_resume() { return handle.promise().result(); }
+
+private:
+    explicit W1Task(handle_t _handle) : handle(_handle) {}
+
+    void reset()
+    {
+        if (handle)
+        {
+            handle.destroy();
+            handle = nullptr;
+        }
+    }
+
+    handle_t handle;
+};
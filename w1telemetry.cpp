@@ -0,0 +1,445 @@
+#include "w1telemetry.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "w1clock.h"
+
+//------------------------------------------------------------------------------
+// Writer
+//------------------------------------------------------------------------------
+W1TelemetryWriter::W1TelemetryWriter()
+{
+
+}
+
+W1TelemetryWriter::~W1TelemetryWriter()
+{
+    close();
+}
+
+int W1TelemetryWriter::open(QString fileName)
+{
+    // pick up where an existing log ended
+    W1TelemetryReader reader;
+    size_t end = W1TLM_HEADER_SIZE;
+    romIndex.clear();
+    lastUs = 0;
+    if (access(fileName.toLocal8Bit().constData(), F_OK) == 0)
+    {
+        if (reader.open(fileName) != 0)
+        {
+            return -1;
+        }
+
+        w1telemetry_entry_t entry;
+        while (reader.next(&entry))
+        {
+        }
+        end = reader.endOffset();
+        lastUs = reader.lastTimeUs();
+        for (int i = 0; i < reader.roms().count(); i++)
+        {
+            romIndex.insert(reader.roms()[i], i);
+        }
+        reader.close();
+    }
+
+    fd = ::open(fileName.toLocal8Bit().constData(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Could not open telemetry log: %m\n");
+        return -1;
+    }
+
+    used = end;
+    mapSize = 0;
+    if (grow() != 0)
+    {
+        ::close(fd);
+        fd = -1;
+        return -1;
+    }
+
+    if (end == W1TLM_HEADER_SIZE)
+    {
+        memset(map, 0, W1TLM_HEADER_SIZE);
+        memcpy(map, W1TLM_MAGIC, 8);
+        uint32_t version = W1TLM_VERSION;
+        uint32_t recordSize = sizeof(w1telemetry_record_t);
+        memcpy(map + 8, &version, 4);
+        memcpy(map + 12, &recordSize, 4);
+    }
+
+    synced = used;
+    lastSyncUs = w1_now_us();
+    records = 0;
+
+    return 0;
+}
+
+void W1TelemetryWriter::close()
+{
+    if (fd == -1)
+    {
+        return;
+    }
+
+    sync();
+    munmap(map, mapSize);
+    if (ftruncate(fd, used) != 0)
+    {
+        fprintf(stderr, "Could not truncate telemetry log: %m\n");
+    }
+    ::close(fd);
+
+    fd = -1;
+    map = nullptr;
+    mapSize = 0;
+}
+
+int W1TelemetryWriter::grow()
+{
+    size_t newSize = ((used + W1TLM_CHUNK_SIZE) / W1TLM_CHUNK_SIZE) * W1TLM_CHUNK_SIZE;
+    if (ftruncate(fd, newSize) != 0)
+    {
+        fprintf(stderr, "Could not grow telemetry log: %m\n");
+        return -1;
+    }
+
+    void *mem;
+    if (map == nullptr)
+    {
+        mem = mmap(NULL, newSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    } else {
+        mem = mremap(map, mapSize, newSize, MREMAP_MAYMOVE);
+    }
+    if (mem == MAP_FAILED)
+    {
+        fprintf(stderr, "Could not map telemetry log: %m\n");
+        return -1;
+    }
+
+    map = (uint8_t *) mem;
+    mapSize = newSize;
+
+    return 0;
+}
+
+int W1TelemetryWriter::sync()
+{
+    if (fd == -1)
+    {
+        return -1;
+    }
+
+    if (msync(map, used, MS_SYNC) != 0)
+    {
+        fprintf(stderr, "Could not sync telemetry log: %m\n");
+        return -1;
+    }
+    synced = used;
+    lastSyncUs = w1_now_us();
+
+    return 0;
+}
+
+void W1TelemetryWriter::maybeSync(int64_t now)
+{
+    if (now - lastSyncUs < (int64_t) W1TLM_SYNC_MS * 1000)
+    {
+        return;
+    }
+
+    // only schedule the writeback, the caller may be the bus thread
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t start = synced & ~(page - 1);
+    msync(map + start, used - start, MS_ASYNC);
+    synced = used;
+    lastSyncUs = now;
+}
+
+int W1TelemetryWriter::reserve(int count)
+{
+    if (fd == -1)
+    {
+        return -1;
+    }
+
+    if (used + (count + 1) * sizeof(w1telemetry_record_t) > mapSize && grow() != 0)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+uint32_t W1TelemetryWriter::timestamp()
+{
+    int64_t now = w1_realtime_us();
+    int64_t delta = now - lastUs;
+    if (delta < 0 || delta > UINT32_MAX)
+    {
+        writeRecord(W1TLM_TIME_SYNC, W1TLM_NO_ROM, (const uint8_t *) &now, 8, 0);
+        delta = 0;
+    }
+    lastUs = now;
+
+    return delta;
+}
+
+int W1TelemetryWriter::append(w1telemetry_type_t type, uint16_t rom, const uint8_t *data,
+                              uint8_t len)
+{
+    if (reserve(1) != 0)
+    {
+        return -1;
+    }
+
+    writeRecord(type, rom, data, len, timestamp());
+
+    maybeSync(w1_now_us());
+
+    return 0;
+}
+
+void W1TelemetryWriter::writeRecord(w1telemetry_type_t type, uint16_t rom, const uint8_t *data,
+                                    uint8_t len, uint32_t deltaUs)
+{
+    w1telemetry_record_t *record = (w1telemetry_record_t *) (map + used);
+    record->len = len;
+    record->rom = rom;
+    record->deltaUs = deltaUs;
+    memset(record->data, 0, W1TLM_RECORD_DATA);
+    memcpy(record->data, data, len & ~W1TLM_CONTINUED);
+    // the type goes in last, a reader of a crashed log stops at type 0
+    __atomic_store_n(&record->type, (uint8_t) type, __ATOMIC_RELEASE);
+
+    used += sizeof(w1telemetry_record_t);
+    records++;
+}
+
+int W1TelemetryWriter::internRom(uint64_t rom)
+{
+    uint16_t index = romIndex.value(rom, W1TLM_NO_ROM);
+    if (index != W1TLM_NO_ROM)
+    {
+        return index;
+    }
+
+    if (romIndex.count() >= W1TLM_NO_ROM)
+    {
+        fprintf(stderr, "Telemetry rom table full\n");
+        return -1;
+    }
+
+    index = romIndex.count();
+    if (append(W1TLM_ROM_DEFINE, index, (const uint8_t *) &rom, 8) != 0)
+    {
+        return -1;
+    }
+    romIndex.insert(rom, index);
+
+    return index;
+}
+
+int W1TelemetryWriter::logReading(uint64_t rom, const uint8_t *data, int len)
+{
+    int index = internRom(rom);
+    if (index < 0 || len > W1TLM_MAX_READING)
+    {
+        return -1;
+    }
+
+    // one timestamp for the whole reading, the continuation records follow
+    // with delta 0 and nothing may come between them
+    int count = len > 0 ? (len + W1TLM_RECORD_DATA - 1) / W1TLM_RECORD_DATA : 1;
+    if (reserve(count) != 0)
+    {
+        return -1;
+    }
+    uint32_t delta = timestamp();
+
+    do {
+        int chunk = len > W1TLM_RECORD_DATA ? W1TLM_RECORD_DATA : len;
+        uint8_t flags = len > chunk ? W1TLM_CONTINUED : 0;
+        writeRecord(W1TLM_READING, index, data, chunk | flags, delta);
+        delta = 0;
+
+        data += chunk;
+        len -= chunk;
+    } while (len > 0);
+
+    maybeSync(w1_now_us());
+
+    return 0;
+}
+
+int W1TelemetryWriter::logEvent(uint64_t rom, w1telemetry_type_t type, uint32_t arg)
+{
+    int index = rom != 0 ? internRom(rom) : W1TLM_NO_ROM;
+    if (index < 0)
+    {
+        return -1;
+    }
+
+    return append(type, index, (const uint8_t *) &arg, 4);
+}
+
+//------------------------------------------------------------------------------
+// Reader
+//------------------------------------------------------------------------------
+W1TelemetryReader::W1TelemetryReader()
+{
+
+}
+
+W1TelemetryReader::~W1TelemetryReader()
+{
+    close();
+}
+
+int W1TelemetryReader::open(QString fileName)
+{
+    int fd = ::open(fileName.toLocal8Bit().constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Could not open telemetry log: %m\n");
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < W1TLM_HEADER_SIZE)
+    {
+        fprintf(stderr, "Telemetry log is truncated\n");
+        ::close(fd);
+        return -1;
+    }
+
+    void *mem = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mem == MAP_FAILED)
+    {
+        fprintf(stderr, "Could not map telemetry log: %m\n");
+        return -1;
+    }
+
+    map = (const uint8_t *) mem;
+    size = st.st_size;
+
+    uint32_t recordSize;
+    memcpy(&recordSize, map + 12, 4);
+    if (memcmp(map, W1TLM_MAGIC, 8) != 0 || recordSize != sizeof(w1telemetry_record_t))
+    {
+        fprintf(stderr, "%s is not a telemetry log\n", fileName.toLocal8Bit().constData());
+        close();
+        return -1;
+    }
+
+    rewind();
+
+    return 0;
+}
+
+void W1TelemetryReader::close()
+{
+    if (map != nullptr)
+    {
+        munmap((void *) map, size);
+        map = nullptr;
+    }
+}
+
+void W1TelemetryReader::rewind()
+{
+    pos = W1TLM_HEADER_SIZE;
+    timeUs = 0;
+    romTable.clear();
+}
+
+const w1telemetry_record_t *W1TelemetryReader::nextRecord()
+{
+    if (map == nullptr || pos + sizeof(w1telemetry_record_t) > size)
+    {
+        return nullptr;
+    }
+
+    const w1telemetry_record_t *record = (const w1telemetry_record_t *) (map + pos);
+    if (record->type == W1TLM_END)
+    {
+        return nullptr;
+    }
+
+    pos += sizeof(w1telemetry_record_t);
+    timeUs += record->deltaUs;
+
+    return record;
+}
+
+bool W1TelemetryReader::next(w1telemetry_entry_t *entry)
+{
+    const w1telemetry_record_t *record;
+    while ((record = nextRecord()) != nullptr)
+    {
+        if (record->type == W1TLM_ROM_DEFINE)
+        {
+            uint64_t rom;
+            memcpy(&rom, record->data, 8);
+            while (romTable.count() <= record->rom)
+            {
+                romTable << 0;
+            }
+            romTable[record->rom] = rom;
+            continue;
+        }
+
+        if (record->type == W1TLM_TIME_SYNC)
+        {
+            memcpy(&timeUs, record->data, 8);
+            continue;
+        }
+
+        entry->timeUs = timeUs;
+        entry->type = (w1telemetry_type_t) record->type;
+        entry->rom = record->rom < romTable.count() ? romTable[record->rom] : 0;
+        entry->len = 0;
+
+        // join continued readings
+        for (;;)
+        {
+            int chunk = record->len & ~W1TLM_CONTINUED;
+            if (chunk > W1TLM_RECORD_DATA || entry->len + chunk > W1TLM_MAX_READING)
+            {
+                return false;
+            }
+            memcpy(entry->data + entry->len, record->data, chunk);
+            entry->len += chunk;
+
+            if (!(record->len & W1TLM_CONTINUED))
+            {
+                break;
+            }
+            // older logs may carry a time sync between the chunks
+            do {
+                record = nextRecord();
+                if (record == nullptr)
+                {
+                    return false;
+                }
+                if (record->type == W1TLM_TIME_SYNC)
+                {
+                    memcpy(&timeUs, record->data, 8);
+                }
+            } while (record->type == W1TLM_TIME_SYNC);
+        }
+
+        return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <QHash>
+#include <QList>
+#include <QString>
+
+#include <stdint.h>
+
+#define W1TLM_MAGIC        "W1TLM001"
+#define W1TLM_VERSION      1
+#define W1TLM_HEADER_SIZE  64
+#define W1TLM_CHUNK_SIZE   (1024 * 1024)
+#define W1TLM_SYNC_MS      1000
+#define W1TLM_RECORD_DATA  8
+#define W1TLM_MAX_READING  64
+#define W1TLM_NO_ROM       0xFFFF
+
+/*!
+ * \brief record types, 0 marks the end of the log
+ */
+enum w1telemetry_type_t {
+    W1TLM_END = 0,
+    W1TLM_ROM_DEFINE,   // data is the 64 bit id of rom index
+    W1TLM_TIME_SYNC,    // data is the absolute time in us
+    W1TLM_READING,      // reading bytes, see W1TLM_CONTINUED
+    W1TLM_FOUND,
+    W1TLM_REMOVED,
+    W1TLM_ERROR         // data is a 32 bit error code
+};
+
+// set in len when the next record continues this reading
+#define W1TLM_CONTINUED 0x80
+
+/*!
+ * \brief fixed size on-disk record, little endian
+ *
+ * deltaUs is the CLOCK_REALTIME distance to the previous record, rom is the
+ * index assigned by an earlier W1TLM_ROM_DEFINE record.
+ */
+struct w1telemetry_record_t {
+    uint8_t type;
+    uint8_t len;
+    uint16_t rom;
+    uint32_t deltaUs;
+    uint8_t data[W1TLM_RECORD_DATA];
+} __attribute__((packed));
+
+/*!
+ * \brief decoded log entry as returned by W1TelemetryReader
+ */
+struct w1telemetry_entry_t {
+    int64_t timeUs;
+    w1telemetry_type_t type;
+    uint64_t rom;
+    int len;
+    uint8_t data[W1TLM_MAX_READING];
+};
+
+/*!
+ * \class W1TelemetryWriter
+ *
+ * \brief Append-only binary log of readings and bus events
+ *
+ * Records are stored into a memory mapped file that grows in chunks, so
+ * logging is a few stores and only touches the kernel when a chunk is full
+ * or the periodic msync is due. On close the file is truncated to its
+ * content. Opening an existing log appends to it.
+ */
+class W1TelemetryWriter
+{
+public:
+    W1TelemetryWriter();
+    ~W1TelemetryWriter();
+
+    /*!
+     * \brief open - creates a log or appends to an existing one
+     * \return 0 on success, -1 on failure
+     */
+    int open(QString fileName);
+    void close();
+
+    int logReading(uint64_t rom, const uint8_t *data, int len);
+    int logEvent(uint64_t rom, w1telemetry_type_t type, uint32_t arg = 0);
+
+    /*!
+     * \brief sync - writes all records to disk and waits for it
+     */
+    int sync();
+
+    uint64_t recordCount() const { return records; }
+
+private:
+    int append(w1telemetry_type_t type, uint16_t rom, const uint8_t *data, uint8_t len);
+    /*!
+     * \brief reserve - makes room for count records and a time sync in front
+     * \return 0 on success, -1 on failure
+     */
+    int reserve(int count);
+    /*!
+     * \brief timestamp - writes a time sync record if the time since the last
+     * record does not fit into a delta
+     * \return delta for the next record
+     */
+    uint32_t timestamp();
+    void writeRecord(w1telemetry_type_t type, uint16_t rom, const uint8_t *data, uint8_t len,
+                     uint32_t deltaUs);
+    int internRom(uint64_t rom);
+    int grow();
+    void maybeSync(int64_t now);
+
+    int fd = -1;
+    uint8_t *map = nullptr;
+    size_t mapSize = 0;
+    size_t used = 0;
+    size_t synced = 0;
+    int64_t lastUs = 0;
+    int64_t lastSyncUs = 0;
+    uint64_t records = 0;
+    QHash<uint64_t, uint16_t> romIndex;
+};
+
+/*!
+ * \class W1TelemetryReader
+ *
+ * \brief Iterates over a telemetry log for offline analysis
+ */
+class W1TelemetryReader
+{
+public:
+    W1TelemetryReader();
+    ~W1TelemetryReader();
+
+    /*!
+     * \return 0 on success, -1 on failure
+     */
+    int open(QString fileName);
+    void close();
+
+    /*!
+     * \brief next - decodes the next reading or event, ROM definitions and
+     * time syncs are consumed internally
+     * \return true if entry was filled, false at the end of the log
+     */
+    bool next(w1telemetry_entry_t *entry);
+    void rewind();
+
+    /*!
+     * \brief roms - ids defined so far, indexed by their rom index
+     */
+    const QList<uint64_t> &roms() const { return romTable; }
+    /*!
+     * \brief endOffset - file offset behind the last complete record
+     */
+    size_t endOffset() const { return pos; }
+    int64_t lastTimeUs() const { return timeUs; }
+
+private:
+    const w1telemetry_record_t *nextRecord();
+
+    const uint8_t *map = nullptr;
+    size_t size = 0;
+    size_t pos = 0;
+    int64_t timeUs = 0;
+    QList<uint64_t> romTable;
+};
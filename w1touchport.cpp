@@ -0,0 +1,136 @@
+#include "w1touchport.h"
+
+#include <string.h>
+
+#include "w1clock.h"
+
+W1TouchPort::W1TouchPort()
+    : eventHead(0), eventTail(0)
+{
+    memset(&statistics, 0, sizeof(statistics));
+}
+
+void W1TouchPort::setRemoveMisses(int _misses)
+{
+    removeMisses = _misses > 0 ? _misses : 1;
+}
+
+int W1TouchPort::poll(W1Bridge &ds, event_t *event)
+{
+    event_t result;
+    result.type = EVENT_NONE;
+    result.rom = current;
+    result.latencyUs = 0;
+
+    statistics.polls++;
+    result.timeUs = w1_now_us();
+
+    int presence = ds.w1_reset();
+    if (presence < 0)
+    {
+        statistics.busErrors++;
+        if (event != nullptr)
+        {
+            *event = result;
+        }
+        return -1;
+    }
+
+    int ret = 0;
+    if (presence == 0)
+    {
+        firstPresenceUs = -1;
+        if (current != 0 && ++misses >= removeMisses)
+        {
+            result.type = EVENT_REMOVED;
+            current = 0;
+            statistics.removed++;
+        }
+    } else if (current != 0) {
+        misses = 0;
+    } else {
+        if (firstPresenceUs < 0)
+        {
+            firstPresenceUs = result.timeUs;
+        }
+
+        for (int attempt = 0; attempt <= W1TOUCH_READ_RETRIES; attempt++)
+        {
+            // the first attempt uses the reset of the presence check
+            if (attempt > 0 && ds.w1_reset() <= 0)
+            {
+                break;
+            }
+
+            uint64_t rom;
+            int read = ds.w1_read_rom(&rom);
+            if (read == -1)
+            {
+                statistics.busErrors++;
+                ret = -1;
+                break;
+            }
+            // a line held low reads as an all zero id with a valid CRC
+            if (read != 0 || rom == 0)
+            {
+                statistics.crcErrors++;
+                continue;
+            }
+
+            int64_t now = w1_now_us();
+            result.type = EVENT_INSERTED;
+            result.rom = rom;
+            result.timeUs = now;
+            result.latencyUs = now - firstPresenceUs;
+
+            current = rom;
+            misses = 0;
+            firstPresenceUs = -1;
+            statistics.inserted++;
+            statistics.totalLatencyUs += result.latencyUs;
+            if (result.latencyUs > statistics.maxLatencyUs)
+            {
+                statistics.maxLatencyUs = result.latencyUs;
+            }
+            break;
+        }
+    }
+
+    if (result.type != EVENT_NONE)
+    {
+        queue(result);
+    }
+    if (event != nullptr)
+    {
+        *event = result;
+    }
+
+    return ret;
+}
+
+void W1TouchPort::queue(const event_t &event)
+{
+    uint32_t head = eventHead.load(std::memory_order_relaxed);
+    if (head - eventTail.load(std::memory_order_acquire) >= W1TOUCH_EVENT_QUEUE)
+    {
+        // nobody takes the events, keep the oldest ones
+        return;
+    }
+
+    events[head % W1TOUCH_EVENT_QUEUE] = event;
+    eventHead.store(head + 1, std::memory_order_release);
+}
+
+bool W1TouchPort::takeEvent(event_t *event)
+{
+    uint32_t tail = eventTail.load(std::memory_order_relaxed);
+    if (tail == eventHead.load(std::memory_order_acquire))
+    {
+        return false;
+    }
+
+    *event = events[tail % W1TOUCH_EVENT_QUEUE];
+    eventTail.store(tail + 1, std::memory_order_release);
+
+    return true;
+}
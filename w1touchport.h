@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+
+#include "w1bridge.h"
+
+#define W1TOUCH_DEFAULT_POLL_US 2000
+// missing presence pulses before a device counts as removed
+#define W1TOUCH_REMOVE_MISSES   3
+#define W1TOUCH_READ_RETRIES    2
+#define W1TOUCH_EVENT_QUEUE     64
+
+/*!
+ * \class W1TouchPort
+ *
+ * \brief Detects devices on a single-drop port such as an iButton reader
+ *
+ * With at most one device on the segment a search is not needed: every
+ * poll is a single reset, and when a presence pulse appears the id is read
+ * with READ ROM and checked with its CRC. A few missing presence pulses in
+ * a row count as removal, so contact bounce while the button is held does
+ * not produce events. A CRC error (e.g. two devices, or a bouncing contact
+ * during the read) is retried in the same poll and then on the next one.
+ *
+ * poll() is meant to run periodically, e.g. from W1RealtimeThread. It does
+ * not allocate or print; events are also queued for another thread to take
+ * with takeEvent().
+ */
+class W1TouchPort
+{
+public:
+    enum event_type_t {
+        EVENT_NONE = 0,
+        EVENT_INSERTED,
+        EVENT_REMOVED
+    };
+
+    struct event_t {
+        event_type_t type;
+        uint64_t rom;
+        int64_t timeUs;
+        int64_t latencyUs;      // first presence pulse to id, inserted only
+    };
+
+    struct stats_t {
+        uint64_t polls;
+        uint32_t inserted;
+        uint32_t removed;
+        uint32_t crcErrors;
+        uint32_t busErrors;
+        int64_t maxLatencyUs;
+        int64_t totalLatencyUs;
+    };
+
+    W1TouchPort();
+
+    void setRemoveMisses(int misses);
+
+    /*!
+     * \brief poll - one presence check, reads the id of a new device
+     * \param event - receives the event of this poll, may be nullptr
+     * \return 0 on success, -1 on bus errors
+     */
+    int poll(W1Bridge &ds, event_t *event = nullptr);
+    /*!
+     * \brief takeEvent - takes the oldest queued event, safe to call from
+     * another thread than poll()
+     * \return true if an event was taken
+     */
+    bool takeEvent(event_t *event);
+
+    // device on the port, 0 if none
+    uint64_t device() const { return current; }
+    stats_t stats() const { return statistics; }
+
+private:
+    void queue(const event_t &event);
+
+    uint64_t current = 0;
+    int misses = 0;
+    int removeMisses = W1TOUCH_REMOVE_MISSES;
+    int64_t firstPresenceUs = -1;
+    stats_t statistics;
+
+    // single producer, single consumer
+    event_t events[W1TOUCH_EVENT_QUEUE];
+    std::atomic<uint32_t> eventHead;
+    std::atomic<uint32_t> eventTail;
+};